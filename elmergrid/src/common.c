@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <time.h> 
 
@@ -607,9 +608,27 @@ int EchoFile(char *filename)
 
 
 int next_int(char **start)
-{
-  int i;
-  char *end;
+/* Reads the next integer. Plain decimal numbers are converted directly,
+   everything else is left to strtol. */
+{
+  int i,neg;
+  long long n;
+  char *cp,*end;
+
+  cp = *start;
+  while(*cp == ' ' || (*cp >= '\t' && *cp <= '\r')) cp++;
+  neg = (*cp == '-');
+  if(*cp == '-' || *cp == '+') cp++;
+
+  if(*cp >= '0' && *cp <= '9') {
+    n = 0;
+    for(i=0;i<18 && *cp >= '0' && *cp <= '9';i++,cp++)
+      n = 10*n + (*cp - '0');
+    if((*cp < '0' || *cp > '9') && n <= INT_MAX) {
+      *start = cp;
+      return(neg ? (int) -n : (int) n);
+    }
+  }
 
   i = strtol(*start,&end,10);
   *start = end;
@@ -617,11 +636,91 @@ int next_int(char **start)
 }
 
 
+/* Exactly representable powers of ten */
+static const double pow10tab[] = {1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,
+				  1e11,1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,
+				  1e20,1e21,1e22};
+
 Real next_real(char **start)
+/* Reads the next real number. When the digits and the exponent are small 
+   enough the result is one correctly rounded operation and thus identical 
+   to the one of strtod, otherwise strtod is used. */
 {
   Real r;
-  char *end;
+  int neg,digits,exp10,expneg,expval,hasdigits;
+  unsigned long long m;
+  char *cp,*end,*ep;
+
+  cp = *start;
+  while(*cp == ' ' || (*cp >= '\t' && *cp <= '\r')) cp++;
+  neg = (*cp == '-');
+  if(*cp == '-' || *cp == '+') cp++;
+
+  m = 0;
+  digits = 0;
+  exp10 = 0;
+  hasdigits = FALSE;
+  while(*cp == '0') {
+    cp++;
+    hasdigits = TRUE;
+  }
+  while(*cp >= '0' && *cp <= '9') {
+    if(digits < 19) m = 10*m + (*cp - '0');
+    else exp10++;
+    digits++;
+    cp++;
+    hasdigits = TRUE;
+  }
+  if(*cp == '.') {
+    cp++;
+    if(!digits) {
+      while(*cp == '0') {
+	cp++;
+	exp10--;
+	hasdigits = TRUE;
+      }
+    }
+    while(*cp >= '0' && *cp <= '9') {
+      if(digits < 19) {
+	m = 10*m + (*cp - '0');
+	exp10--;
+      }
+      digits++;
+      cp++;
+      hasdigits = TRUE;
+    }
+  }
+  if(!hasdigits || digits > 19) goto fallback;
+
+  if(*cp == 'e' || *cp == 'E') {
+    ep = cp+1;
+    expneg = (*ep == '-');
+    if(*ep == '-' || *ep == '+') ep++;
+    if(*ep >= '0' && *ep <= '9') {
+      expval = 0;
+      while(*ep >= '0' && *ep <= '9') {
+	if(expval < 10000) expval = 10*expval + (*ep - '0');
+	ep++;
+      }
+      exp10 += expneg ? -expval : expval;
+      cp = ep;
+    }
+  }
+  /* Hexadecimal numbers and the like */
+  if(*cp == 'x' || *cp == 'X' || *cp == 'p' || *cp == 'P') goto fallback;
+
+  if(m >= (1ULL << 53) || exp10 < -22 || exp10 > 22) goto fallback;
+
+  r = (Real) m;
+  if(exp10 >= 0) 
+    r *= pow10tab[exp10];
+  else
+    r /= pow10tab[-exp10];
+
+  *start = cp;
+  return(neg ? -r : r);
 
+ fallback:
   r = strtod(*start,&end);
 
   *start = end;
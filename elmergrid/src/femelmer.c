@@ -41,6 +41,10 @@
 #include <stdarg.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "nrutil.h"
 #include "common.h"
@@ -55,6 +59,18 @@
 
 #define getline fgets(line,MAXLINESIZE,in) 
 
+/* Size of the output buffer for each file of the partitioned mesh */
+#define PARTBUFSIZE (1<<20)
+
+static Real WallTime()
+{
+#ifdef _OPENMP
+  return(omp_get_wtime());
+#else
+  return(clock() / (double)CLOCKS_PER_SEC);
+#endif
+}
+
 
 int LoadSolutionElmer(struct FemType *data,int results,char *prefix,int info)
 /* This procedure reads the solution in a form that is understood 
@@ -182,35 +198,191 @@ end:
 
 
 
-int FuseSolutionElmerPartitioned(char *prefix,char *outfile,int decimals,int parts,
+/* Number of partitions whose results are kept in memory at the same time */
+#define FUSEBATCH 64
+
+/* The state of one partitioned result file while fusing. The files are 
+   reopened at the stored position when there are too many to keep open. */
+struct FusePartType {
+  FILE *in;
+  long pos;
+  int noknots,noelements,failed;
+  int *gid;
+  char *buf;
+  size_t bufsize,buflen;
+};
+
+
+static void FuseOpen(struct FusePartType *part,char *prefix,int k)
+{
+  char filename[MAXFILESIZE];
+
+  if(part->in) return;
+  sprintf(filename,"%s.ep.%d",prefix,k);
+  part->in = fopen(filename,"r");
+  if(part->in) 
+    fseek(part->in,part->pos,SEEK_SET);
+  else
+    part->failed = TRUE;
+}
+
+
+static void FuseClose(struct FusePartType *part)
+{
+  if(!part->in) return;
+  part->pos = ftell(part->in);
+  fclose(part->in);
+  part->in = NULL;
+}
+
+
+static int FuseGetLine(struct FusePartType *part,char *line,int size)
+{
+  if(!part->in || !fgets(line,size,part->in)) {
+    line[0] = '\0';
+    part->failed = TRUE;
+    return(FALSE);
+  }
+  return(TRUE);
+}
+
+
+static void FuseAppend(struct FusePartType *part,const char *format,...)
+/* Appends formatted text to the output buffer of the partition */
+{
+  va_list ap;
+  int len;
+
+  for(;;) {
+    va_start(ap,format);
+    len = vsnprintf(part->buf+part->buflen,part->bufsize-part->buflen,format,ap);
+    va_end(ap);
+    if(len >= 0 && part->buflen+len < part->bufsize) break;
+    part->bufsize = 2*part->bufsize + (len > 0 ? len : 0);
+    part->buf = (char*) realloc(part->buf,part->bufsize);
+    if(!part->buf) bigerror("FuseAppend: allocation of the output buffer failed");
+  }
+  part->buflen += len;
+}
+
+
+static int FuseGlobalIds(struct FusePartType *partfiles,int nofiles,char *prefix,
+			 char *meshdir,int **globalind,int **ownerpart,int *maxgid,int info)
+/* Reads the global node ids of the partitions from part.N.nodes of the mesh
+   directory. The node is numbered and owned by the first partition where it
+   appears. Returns the number of distinct nodes, or 0 if the ids could not 
+   be used and the nodes are to be saved separately for each partition. */
+{
+  int i,k,gid,noknots,failed;
+  int *globalindex,*owner;
+  char dirname[MAXFILESIZE],filename[MAXFILESIZE],line[MAXLINESIZE],*cp;
+  FILE *in;
+  struct FusePartType *part;
+
+  /* By default the results are assumed to be saved in the mesh directory */
+  if(meshdir) 
+    strcpy(dirname,meshdir);
+  else {
+    strcpy(dirname,prefix);
+    cp = strrchr(dirname,'/');
+    if(cp) 
+      *cp = '\0';
+    else 
+      strcpy(dirname,".");
+  }
+
+  failed = FALSE;
+  *maxgid = 0;
+
+#pragma omp parallel for private(i,gid,in,filename,line,part) reduction(||:failed) schedule(dynamic,1)
+  for(k=0;k<nofiles;k++) {
+    part = &partfiles[k];
+    part->gid = NULL;
+    sprintf(filename,"%s/partitioning.%d/part.%d.nodes",dirname,nofiles,k+1);
+    if((in = fopen(filename,"r")) == NULL) {
+      failed = TRUE;
+      continue;
+    }
+    part->gid = Ivector(0,MAX(part->noknots,1)-1);
+    for(i=0;i<part->noknots;i++) {
+      if(!fgets(line,MAXLINESIZE,in) || sscanf(line,"%d",&gid) != 1 || gid < 1) break;
+      part->gid[i] = gid;
+    }
+    /* The results must have been saved for exactly the nodes of the mesh partition */
+    if(i < part->noknots || fgets(line,MAXLINESIZE,in)) failed = TRUE;
+    fclose(in);
+  }
+
+  if(!failed) {
+    for(k=0;k<nofiles;k++) 
+      for(i=0;i<partfiles[k].noknots;i++) 
+	*maxgid = MAX(*maxgid,partfiles[k].gid[i]);
+  }
+  else {
+    if(info) printf("Global node ids not available in %s/partitioning.%d, saving nodes of each partition\n",
+		    dirname,nofiles);
+    for(k=0;k<nofiles;k++) {
+      if(partfiles[k].gid) free_Ivector(partfiles[k].gid,0,MAX(partfiles[k].noknots,1)-1);
+      partfiles[k].gid = NULL;
+    }
+    return(0);
+  }
+
+  globalindex = Ivector(1,*maxgid);
+  owner = Ivector(1,*maxgid);
+  for(i=1;i<=*maxgid;i++) 
+    globalindex[i] = owner[i] = -1;
+
+  noknots = 0;
+  for(k=0;k<nofiles;k++) {
+    for(i=0;i<partfiles[k].noknots;i++) {
+      gid = partfiles[k].gid[i];
+      if(owner[gid] >= 0) continue;
+      owner[gid] = k;
+      globalindex[gid] = noknots++;
+    }
+  }
+  if(info) printf("Merging the shared nodes by the global node ids in %s/partitioning.%d\n",
+		  dirname,nofiles);
+
+  *globalind = globalindex;
+  *ownerpart = owner;
+  return(noknots);
+}
+
+
+int FuseSolutionElmerPartitioned(char *prefix,char *outfile,char *meshdir,int decimals,int parts,
 				 int minstep, int maxstep, int dstep, int info)
+/* Fuses the ElmerPost results of the partitions into one file. The partitions are 
+   processed in batches of FUSEBATCH and the results of one timestep are read, 
+   formatted in parallel and written before continuing to the next one. 
+   Nodes shared by partitions are written once using the global node ids of 
+   the partitioned mesh, if found in meshdir or in the directory of the results. */
 {
 #define LONGLINE 2048
-  int *noknots,*noelements,novctrs,elemcode;
+  int novctrs,elemcode;
   int totknots,totelements,sumknots,sumelements;
   int timesteps,i,j,k,l,step;
   int ind[MAXNODESD3];
-  int nofiles,activestep;
+  int nofiles,activestep,keepopen,batch,batchend,stage,maxgid,merge;
+  int *knotoffset,*globalindex,*ownerpart;
   Real *res, x, y, z;
-  FILE *in[MAXPARTITIONS+1],*intest,*out;
-  char line[LONGLINE],filename[MAXFILESIZE],text[MAXNAMESIZE],outstyle[MAXFILESIZE];
+  FILE *intest,*out;
+  char line[LONGLINE],header[LONGLINE],filename[MAXFILESIZE],text[MAXNAMESIZE];
+  char coordstyle[MAXFILESIZE],outstyle[MAXFILESIZE];
   char *cp;
+  struct FusePartType *partfiles,*part;
 
   if(minstep || maxstep || dstep) {
     if(info) printf("Saving results in the interval from %d to %d with step %d\n",minstep,maxstep,dstep);
   }
 
   for(i=0;;i++) {
+    if(parts > 0 && i >= parts) break;
     sprintf(filename,"%s.ep.%d",prefix,i);
     if ((intest = fopen(filename,"r")) == NULL) break;
-    if(i<=MAXPARTITIONS) in[i] = intest;
+    fclose(intest);
   }
-  if(i > MAXPARTITIONS) {
-    printf("**********************************************************\n");
-    printf("Only data for %d partitions is fused (%d)\n",MAXPARTITIONS,i);
-    printf("**********************************************************\n");
-    i = MAXPARTITIONS;
-  } 
   nofiles = i;
 
   if(nofiles < 2) {
@@ -218,38 +390,60 @@ int FuseSolutionElmerPartitioned(char *prefix,char *outfile,int decimals,int par
 	   filename);
     return(2);
   } else {
-    if(parts > 0) nofiles = MIN(parts,nofiles);
     if(info) printf("Loading Elmer results from %d partitions.\n",nofiles);
   }
 
-  if(minstep || maxstep || dstep) {
-    if(info) printf("Saving results in the interval from %d to %d with step %d\n",minstep,maxstep,dstep);
+  /* With many partitions the files are opened only for the batch being processed */
+  keepopen = (nofiles <= MAXPARTITIONS);
+
+  partfiles = (struct FusePartType*) malloc((size_t) nofiles*sizeof(struct FusePartType));
+  for(k=0;k<nofiles;k++) {
+    part = &partfiles[k];
+    part->in = NULL;
+    part->pos = 0;
+    part->failed = FALSE;
+    part->gid = NULL;
+    part->bufsize = LONGLINE;
+    part->buflen = 0;
+    part->buf = (char*) malloc(part->bufsize);
   }
+  knotoffset = Ivector(0,nofiles);
 
-  noknots = Ivector(0,nofiles-1);
-  noelements = Ivector(0,nofiles-1);
- 
   sumknots = 0;
   sumelements = 0;
-
-  for(i=0;i<nofiles;i++) {
-    fgets(line,LONGLINE,in[i]);
-    if(i==0) {
+  novctrs = timesteps = 0;
+  header[0] = '\0';
+
+  for(k=0;k<nofiles;k++) {
+    part = &partfiles[k];
+    FuseOpen(part,prefix,k);
+    FuseGetLine(part,line,LONGLINE);
+    if(k==0) {
       cp = line;
-      noknots[i] = next_int(&cp);
-      noelements[i] = next_int(&cp);
+      part->noknots = next_int(&cp);
+      part->noelements = next_int(&cp);
       novctrs = next_int(&cp);
       timesteps = next_int(&cp);
+      strcpy(header,cp);
     }
     else {
-      sscanf(line,"%d %d",&noknots[i],&noelements[i]);
+      part->noknots = part->noelements = 0;
+      sscanf(line,"%d %d",&part->noknots,&part->noelements);
     }
-    sumknots += noknots[i];
-    sumelements += noelements[i];
+    if(!keepopen) FuseClose(part);
+    knotoffset[k] = sumknots;
+    sumknots += part->noknots;
+    sumelements += part->noelements;
   }
+  knotoffset[nofiles] = sumknots;
   totknots = sumknots;
   totelements = sumelements;
-  res = Rvector(1,novctrs);
+
+  globalindex = ownerpart = NULL;
+  maxgid = 0;
+  i = FuseGlobalIds(partfiles,nofiles,prefix,meshdir,&globalindex,&ownerpart,&maxgid,info);
+  merge = (i > 0);
+  if(merge) totknots = i;
 
   if(info) printf("There are altogether %d nodes and %d elements.\n",totknots,sumelements);
 
@@ -259,8 +453,20 @@ int FuseSolutionElmerPartitioned(char *prefix,char *outfile,int decimals,int par
   out = fopen(filename,"w");
   if(out == NULL) {
     printf("opening of file was not successful\n");
+    for(k=0;k<nofiles;k++) {
+      if(partfiles[k].in) fclose(partfiles[k].in);
+      if(partfiles[k].gid) free_Ivector(partfiles[k].gid,0,MAX(partfiles[k].noknots,1)-1);
+      free(partfiles[k].buf);
+    }
+    free(partfiles);
+    free_Ivector(knotoffset,0,nofiles);
+    if(merge) {
+      free_Ivector(globalindex,1,maxgid);
+      free_Ivector(ownerpart,1,maxgid);
+    }
     return(3);
   }
+  setvbuf(out,NULL,_IOFBF,PARTBUFSIZE);
 
   i = timesteps;
   if(minstep || maxstep || dstep) {
@@ -270,101 +476,145 @@ int FuseSolutionElmerPartitioned(char *prefix,char *outfile,int decimals,int par
         if((step-minstep)%dstep==0) i++;
     } else i=maxstep-minstep+1;
   }
-  fprintf(out,"%d %d %d %d %s %s",totknots,totelements,novctrs+1,i,"scalar: Partition",cp);
+  fprintf(out,"%d %d %d %d %s %s",totknots,totelements,novctrs+1,i,"scalar: Partition",header);
  
-  if(info) printf("Reading and writing %d coordinates.\n",totknots);
-  sprintf(outstyle,"%%.%dg %%.%dg %%.%dg\n",decimals,decimals,decimals);
-
-  for(j=0; j < nofiles; j++) {
-    for(i=1; i <= noknots[j]; i++) {
-      do {
-	fgets(line,LONGLINE,in[j]);
-      } while(line[0] == '#');
-
-      sscanf(line,"%le %le %le",&x,&y,&z);
-      fprintf(out,outstyle,x,y,z);
-    }
-  }
-
-  if(info) printf("Reading and writing %d element topologies.\n",totelements);
-  sumknots = 0;
-
-  for(j=0; j < nofiles; j++) {
-    for(i=1; i <= noelements[j]; i++) {
-      do {
-	fgets(line,LONGLINE,in[j]);
-      } while (line[0] == '#');
+  sprintf(coordstyle,"%%.%dg %%.%dg %%.%dg\n",decimals,decimals,decimals);
+  sprintf(outstyle,"%%.%dg ",decimals);
 
-      sscanf(line,"%s",text);
-      cp = strstr(line," ");
+  activestep = FALSE;
+  if(maxstep) timesteps = MIN(timesteps, maxstep);
 
-      elemcode = next_int(&cp);
+  /* Stage 1 are the coordinates, stage 2 the element topologies, and
+     the rest the timesteps with the degrees of freedom. */
+  for(stage=1;stage<=timesteps+2;stage++) {
 
-      for(k=0;k< elemcode%100 ;k++) {
-	/* Dirty trick for long lines */
-	l = strspn(cp," ");
-	if( l == 0) {
-	  fgets(line,LONGLINE,in[j]);
-	  cp = line;
-	}
-	ind[k] = next_int(&cp);
+    if(stage == 1) {
+      if(info) printf("Reading and writing %d coordinates.\n",totknots);
+    }
+    else if(stage == 2) {
+      if(info) printf("Reading and writing %d element topologies.\n",totelements);
+    }
+    else {
+      step = stage - 2;
+      if(step == 1 && info) printf("Reading and writing %d degrees of freedom.\n",novctrs);
+      if (step>=minstep) {
+	if ( dstep>0 ) {
+	  activestep=((step-minstep)%dstep==0);
+	} else activestep=TRUE;
       }
-      if(elemcode == 102) elemcode = 101;
-
-      fprintf(out,"%s %d",text,elemcode);
-      for(k=0;k < elemcode%100 ;k++)       
-	fprintf(out," %d",ind[k]+sumknots);
-      fprintf(out,"\n");
     }
-    sumknots += noknots[j];
-  }
-
-  if(info) printf("Reading and writing %d degrees of freedom.\n",novctrs);
-  sprintf(outstyle,"%%.%dg ",decimals);
 
-  activestep = FALSE;
-  if(maxstep) timesteps = MIN(timesteps, maxstep);
+    for(batch=0;batch<nofiles;batch+=FUSEBATCH) {
+      batchend = MIN(batch+FUSEBATCH,nofiles);
 
-  for(step = 1; step <= timesteps; step++) {
-        
-    if (step>=minstep) {
-      if ( dstep>0 ) {
-         activestep=((step-minstep)%dstep==0);
-      } else activestep=TRUE;
-    }
+#pragma omp parallel for private(i,j,l,x,y,z,elemcode,ind,res,line,text,cp,part) schedule(dynamic,1)
+      for(k=batch;k<batchend;k++) {
+	part = &partfiles[k];
+	FuseOpen(part,prefix,k);
+	part->buflen = 0;
 
-    for(k=0;k<nofiles;k++) 
-      for(i=1; i <= noknots[k]; i++) {
-	do {
-	  fgets(line,LONGLINE,in[k]);
-          if (activestep) {
-            if(k==0 && strstr(line,"#time")) {
-	      fprintf(out,"%s",line);
-	      fprintf(stderr,"%s",line);
-            }
-          }
+	if(stage == 1) {
+	  for(i=1; i <= part->noknots; i++) {
+	    do {
+	      if(!FuseGetLine(part,line,LONGLINE)) break;
+	    } while(line[0] == '#');
+	    
+	    if(merge && ownerpart[part->gid[i-1]] != k) continue;
+	    sscanf(line,"%le %le %le",&x,&y,&z);
+	    FuseAppend(part,coordstyle,x,y,z);
+	  }
 	}
-	while (line[0] == '#');
-
-	if(activestep) {
-	  cp = line;
-	  for(j=1;j <= novctrs;j++) 
-	    res[j] = next_real(&cp);
-	  
-	  fprintf(out,"%d ",k+1);
-	  for(j=1;j <= novctrs;j++) 
-	    fprintf(out,outstyle,res[j]);
-	  fprintf(out,"\n");
+	else if(stage == 2) {
+	  for(i=1; i <= part->noelements; i++) {
+	    do {
+	      if(!FuseGetLine(part,line,LONGLINE)) break;
+	    } while (line[0] == '#');
+	    
+	    sscanf(line,"%s",text);
+	    cp = strstr(line," ");
+	    if(!cp) break;
+	    
+	    elemcode = next_int(&cp);
+	    
+	    for(l=0;l< elemcode%100 ;l++) {
+	      /* Dirty trick for long lines */
+	      j = strspn(cp," ");
+	      if( j == 0) {
+		FuseGetLine(part,line,LONGLINE);
+		cp = line;
+	      }
+	      ind[l] = next_int(&cp);
+	    }
+	    if(elemcode == 102) elemcode = 101;
+	    
+	    FuseAppend(part,"%s %d",text,elemcode);
+	    for(l=0;l < elemcode%100 ;l++) {
+	      if(merge) 
+		FuseAppend(part," %d",globalindex[part->gid[ind[l]]]);
+	      else
+		FuseAppend(part," %d",ind[l]+knotoffset[k]);
+	    }
+	    FuseAppend(part,"\n");
+	  }
+	}
+	else {
+	  res = Rvector(1,novctrs);
+	  for(i=1; i <= part->noknots; i++) {
+	    do {
+	      if(!FuseGetLine(part,line,LONGLINE)) break;
+	      if (activestep) {
+		if(k==0 && strstr(line,"#time")) {
+		  FuseAppend(part,"%s",line);
+		  fprintf(stderr,"%s",line);
+		}
+	      }
+	    }
+	    while (line[0] == '#');
+	    
+	    if(activestep && !(merge && ownerpart[part->gid[i-1]] != k)) {
+	      cp = line;
+	      for(j=1;j <= novctrs;j++) 
+		res[j] = next_real(&cp);
+	      
+	      FuseAppend(part,"%d ",k+1);
+	      for(j=1;j <= novctrs;j++) 
+		FuseAppend(part,outstyle,res[j]);
+	      FuseAppend(part,"\n");
+	    }
+	  }
+	  free_Rvector(res,1,novctrs);
 	}
 
+	if(!keepopen) FuseClose(part);
       }
-  }
 
+      /* The partitions are written in order */
+      for(k=batch;k<batchend;k++) 
+	fwrite(partfiles[k].buf,1,partfiles[k].buflen,out);
+    }
+  }
 
-  for(i=0;i<nofiles;i++) 
-    fclose(in[i]);
+  j = 0;
+  for(k=0;k<nofiles;k++) {
+    part = &partfiles[k];
+    if(part->failed) j++;
+    if(part->in) fclose(part->in);
+    if(part->gid) free_Ivector(part->gid,0,MAX(part->noknots,1)-1);
+    free(part->buf);
+  }
+  free(partfiles);
+  free_Ivector(knotoffset,0,nofiles);
+  if(merge) {
+    free_Ivector(globalindex,1,maxgid);
+    free_Ivector(ownerpart,1,maxgid);
+  }
   fclose(out);
 
+  if(j) {
+    printf("Reading of the results failed in %d partitions\n",j);
+    return(5);
+  }
+
   if(info) printf("Successfully fused partitioned Elmer results\n");
 
   return(0);
@@ -504,7 +754,7 @@ int LoadElmerInput(struct FemType *data,struct BoundaryType *bound,
 {
   int noknots,noelements,nosides,maxelemtype;
   int sideind[MAXNODESD1],tottypes,elementtype;
-  int i,j,k,l,dummyint,cdstat,fail;
+  int i,j,k,l,dummyint,cdstat,fail,typecount,totnodes,nodepos,compact;
   FILE *in;
   char line[MAXLINESIZE],filename[MAXFILESIZE],directoryname[MAXFILESIZE];
 
@@ -537,10 +787,14 @@ int LoadElmerInput(struct FemType *data,struct BoundaryType *bound,
   sscanf(line,"%d",&tottypes);
 
   maxelemtype = 0;
+  totnodes = 0;
+  compact = TRUE;
   for(i=1;i<=tottypes;i++) {   
     getline;
-    sscanf(line,"%d",&dummyint);
+    typecount = 0;
+    if(sscanf(line,"%d %d",&dummyint,&typecount) < 2) compact = FALSE;
     if(dummyint > maxelemtype) maxelemtype = dummyint;
+    totnodes += typecount * (dummyint % 100);
   }
   printf("Maximum elementtype index is: %d\n",maxelemtype);
   fclose(in);
@@ -551,9 +805,17 @@ int LoadElmerInput(struct FemType *data,struct BoundaryType *bound,
   data->noknots = noknots;
   data->noelements = noelements;
 
+  /* For bulk elements of different size store the topology compactly right away. 
+     The header counts include also the boundary elements so totnodes is an upper 
+     limit that exceeds the rectangular size when all bulk elements are similar. */
+  compact = compact && ((long long)totnodes < (long long)noelements * data->maxnodes);
 
   if(info) printf("Allocating for %d knots and %d elements.\n",
 		  noknots,noelements);
+  if(compact) {
+    if(info) printf("Allocating a compact topology for %d element nodes.\n",totnodes);
+    AllocateTopology(data,totnodes);
+  }
   AllocateKnots(data);
 
 
@@ -584,6 +846,7 @@ int LoadElmerInput(struct FemType *data,struct BoundaryType *bound,
   else 
     if(info) printf("Loading %d bulk elements from %s\n",noelements,filename);
 
+  nodepos = 0;
   for(i=1; i <= noelements; i++) {
     fscanf(in,"%d",&j);
     if(0 && i != j) printf("LoadElmerInput: i=%d element=%d\n",i,dummyint);
@@ -594,6 +857,12 @@ int LoadElmerInput(struct FemType *data,struct BoundaryType *bound,
       bigerror("Cannot continue with invalid elements");
     }
     data->elementtypes[j] = elementtype;
+    if(compact) {
+      if(nodepos + elementtype%100 > totnodes) 
+	bigerror("LoadElmerInput: element counts in mesh.header do not match the elements");
+      data->topology[j] = data->elemtopo.cols + nodepos;
+      nodepos += elementtype%100;
+    }
     for(k=0;k< elementtype%100 ;k++) {
       fscanf(in,"%d",&l);
       data->topology[j][k] = l;
@@ -604,6 +873,9 @@ int LoadElmerInput(struct FemType *data,struct BoundaryType *bound,
   }
   fclose(in);
 
+  /* Sets the offsets, or packs again if the elements were not in order */
+  if(compact) CompactTopology(data,info);
+
 
   sprintf(filename,"%s","mesh.boundary");
   if ((in = fopen(filename,"r")) == NULL) {
@@ -3247,6 +3519,424 @@ int PartitionSimpleNodes(struct FemType *data,int dimpart[],int dimper[],
 
 
 
+static unsigned long long SfcKey(unsigned int X[],int dim,int bits,int hilbert)
+/* Position of a point with integer coordinates X on the Hilbert or Morton curve.
+   The Hilbert index is computed from the transposed form of J. Skilling,
+   "Programming the Hilbert curve", AIP Conf. Proc. 707 (2004). */
+{
+  unsigned int M,P,Q,t;
+  unsigned long long key;
+  int i,b;
+
+  if(hilbert) {
+    M = 1u << (bits-1);
+    for(Q=M;Q>1;Q>>=1) {
+      P = Q-1;
+      for(i=0;i<dim;i++) {
+	if(X[i] & Q) 
+	  X[0] ^= P;
+	else {
+	  t = (X[0] ^ X[i]) & P;
+	  X[0] ^= t;
+	  X[i] ^= t;
+	}
+      }
+    }
+    for(i=1;i<dim;i++) 
+      X[i] ^= X[i-1];
+    t = 0;
+    for(Q=M;Q>1;Q>>=1) 
+      if(X[dim-1] & Q) t ^= Q-1;
+    for(i=0;i<dim;i++) 
+      X[i] ^= t;
+  }
+
+  /* Interleave the bits starting from the most significant one */
+  key = 0;
+  for(b=bits-1;b>=0;b--) 
+    for(i=0;i<dim;i++) 
+      key = (key << 1) | ((X[i] >> b) & 1);
+
+  return(key);
+}
+
+
+static void SfcRadixSort(int n,int keybits,unsigned long long *key,int *ind,
+			 unsigned long long *key2,int *ind2)
+/* Sorts the keys and the corresponding indexes using a stable LSD radix sort 
+   with 8-bit digits. Each thread counts and scatters its own block of the array. 
+   The result is returned in key and ind. */
+{
+  int shift,maxthreads,skip;
+  int *hist;
+  unsigned long long *tmpkey,*origkey;
+  int *tmpind,*origind;
+
+  origkey = key;
+  origind = ind;
+  maxthreads = 1;
+#ifdef _OPENMP
+  maxthreads = omp_get_max_threads();
+#endif
+  hist = (int*) malloc((size_t) 256*maxthreads*sizeof(int));
+
+  for(shift=0;shift<keybits;shift+=8) {
+    skip = FALSE;
+
+#pragma omp parallel num_threads(maxthreads)
+    {
+      int i,d,t,tid,nthreads,lo,hi,offset,tmp;
+      int *h;
+
+      tid = 0;
+      nthreads = 1;
+#ifdef _OPENMP
+      tid = omp_get_thread_num();
+      nthreads = omp_get_num_threads();
+#endif
+      lo = (int) (((long long) n * tid) / nthreads);
+      hi = (int) (((long long) n * (tid+1)) / nthreads);
+      h = hist + 256*tid;
+
+      for(d=0;d<256;d++) h[d] = 0;
+      for(i=lo;i<hi;i++)
+	h[(key[i] >> shift) & 255] += 1;
+
+#pragma omp barrier
+#pragma omp single
+      {
+	/* Global offsets in the order of digit and thread */
+	offset = 0;
+	for(d=0;d<256;d++) {
+	  for(t=0;t<nthreads;t++) {
+	    tmp = hist[256*t+d];
+	    if(tmp == n) skip = TRUE;
+	    hist[256*t+d] = offset;
+	    offset += tmp;
+	  }
+	}
+      }
+
+      if(!skip) {
+	for(i=lo;i<hi;i++) {
+	  d = (key[i] >> shift) & 255;
+	  key2[h[d]] = key[i];
+	  ind2[h[d]] = ind[i];
+	  h[d] += 1;
+	}
+      }
+    }
+
+    if(skip) continue;
+    tmpkey = key; key = key2; key2 = tmpkey;
+    tmpind = ind; ind = ind2; ind2 = tmpind;
+  }
+
+  /* After an odd number of passes the result is in the work arrays */
+  if(key != origkey) {
+    memcpy(origkey,key,(size_t) n*sizeof(unsigned long long));
+    memcpy(origind,ind,(size_t) n*sizeof(int));
+  }
+  free(hist);
+}
+
+
+static int RepairPartitionConnectivity(struct FemType *data,int *weight,int info)
+/* Elements of a partition that are not connected to its main part via 
+   shared nodes are moved to the neighbouring partition they share most 
+   connections with, unless this would make that partition more than 5 % 
+   heavier than the average. Fragments larger than a quarter of the average 
+   partition are left as they are since they are typically disconnected bodies. */
+{
+  int i,j,k,l,e,e2,n,noelements,nopartitions,nocomps,part,comp,head,tail,best,moved,frags,movedfrags;
+  int *elempart,*compof,*compweight,*mainweight,*maincomp,*queue,*hits,*touched,notouched;
+  int *partweight;
+  int *invrow,*invcol;
+  long long totweight;
+
+  noelements = data->noelements;
+  nopartitions = data->nopartitions;
+  elempart = data->elempart;
+
+  CreateInverseTopology(data,info);
+  invrow = data->invtopo.rows;
+  invcol = data->invtopo.cols;
+
+  compof = Ivector(1,noelements);
+  queue = Ivector(1,noelements);
+  compweight = Ivector(1,noelements);
+  maincomp = Ivector(1,nopartitions);
+  mainweight = Ivector(1,nopartitions);
+  for(i=1;i<=noelements;i++) compof[i] = 0;
+  partweight = Ivector(1,nopartitions);
+  for(i=1;i<=nopartitions;i++) maincomp[i] = mainweight[i] = partweight[i] = 0;
+
+  /* Label the connected components within each partition */
+  totweight = 0;
+  nocomps = 0;
+  for(i=1;i<=noelements;i++) {
+    totweight += weight[i];
+    partweight[elempart[i]] += weight[i];
+    if(compof[i]) continue;
+    nocomps++;
+    part = elempart[i];
+    compof[i] = nocomps;
+    compweight[nocomps] = 0;
+    head = tail = 1;
+    queue[1] = i;
+    while(head <= tail) {
+      e = queue[head++];
+      compweight[nocomps] += weight[e];
+      for(j=0;j<data->elementtypes[e]%100;j++) {
+	n = data->topology[e][j];
+	for(k=invrow[n-1];k<invrow[n];k++) {
+	  e2 = invcol[k]+1;
+	  if(compof[e2] || elempart[e2] != part) continue;
+	  compof[e2] = nocomps;
+	  queue[++tail] = e2;
+	}
+      }
+    }
+    if(compweight[nocomps] > mainweight[part]) {
+      mainweight[part] = compweight[nocomps];
+      maincomp[part] = nocomps;
+    }
+  }
+
+  hits = Ivector(1,nopartitions);
+  touched = Ivector(1,nopartitions);
+  for(i=1;i<=nopartitions;i++) hits[i] = 0;
+
+  /* Move the fragments, one component at a time */
+  moved = frags = movedfrags = 0;
+  for(i=1;i<=noelements;i++) {
+    comp = compof[i];
+    if(comp <= 0) continue;
+    part = elempart[i];
+    if(maincomp[part] == comp) continue;
+    frags++;
+
+    /* Collect the component and the partitions of its neighbours */
+    notouched = 0;
+    head = tail = 1;
+    queue[1] = i;
+    compof[i] = -comp;
+    while(head <= tail) {
+      e = queue[head++];
+      for(j=0;j<data->elementtypes[e]%100;j++) {
+	n = data->topology[e][j];
+	for(k=invrow[n-1];k<invrow[n];k++) {
+	  e2 = invcol[k]+1;
+	  if(compof[e2] == comp) {
+	    compof[e2] = -comp;
+	    queue[++tail] = e2;
+	  }
+	  else if(elempart[e2] != part) {
+	    l = elempart[e2];
+	    if(!hits[l]) touched[++notouched] = l;
+	    hits[l] += 1;
+	  }
+	}
+      }
+    }
+
+    best = 0;
+    for(j=1;j<=notouched;j++) {
+      l = touched[j];
+      if(!best || hits[l] > hits[best]) best = l;
+      hits[l] = 0;
+    }
+    if(!best) continue;
+    if(4 * (long long) compweight[comp] * nopartitions > totweight) continue;
+    if(100 * ((long long) partweight[best] + compweight[comp]) * nopartitions > 105 * totweight) continue;
+
+    for(j=1;j<=tail;j++) 
+      elempart[queue[j]] = best;
+    partweight[best] += compweight[comp];
+    partweight[part] -= compweight[comp];
+    moved += tail;
+    movedfrags++;
+  }
+
+  if(info) printf("There are %d disconnected fragments in the partitions, moved %d of them with %d elements\n",
+		  frags,movedfrags,moved);
+
+  free_Ivector(compof,1,noelements);
+  free_Ivector(queue,1,noelements);
+  free_Ivector(compweight,1,noelements);
+  free_Ivector(maincomp,1,nopartitions);
+  free_Ivector(mainweight,1,nopartitions);
+  free_Ivector(hits,1,nopartitions);
+  free_Ivector(touched,1,nopartitions);
+  free_Ivector(partweight,1,nopartitions);
+
+  return(moved);
+}
+
+
+int PartitionSpaceFillingCurve(struct FemType *data,int partitions,int sfcopt,int info)
+/* Partition the elements by cutting a space-filling curve through the element
+   centroids into pieces of equal weight. This needs only a few arrays of the 
+   size of the elements and is therefore suitable for meshes too large for the 
+   graph partitioning. sfcopt: 0 Hilbert, 1 Morton, add 2 for weighting the 
+   elements by their number of nodes. */
+{
+  int i,j,k,noelements,noknots,dim,bits,hilbert,weighted,part,minpart,maxpart;
+  int *indx,*indx2,*weight,*elempart,*partweight;
+  unsigned long long *key,*key2;
+  long long totweight,cumweight;
+  Real *cx,*cy,*cz,mincoord[3],maxcoord[3],scale;
+
+  noelements = data->noelements;
+  noknots = data->noknots;
+  dim = data->dim;
+  hilbert = (sfcopt % 2 == 0);
+  weighted = (sfcopt / 2 % 2 == 1);
+
+  if(partitions < 2) bigerror("There should be at least two partitions for partitioning!");
+  if(partitions >= noelements) {
+    printf("There must be fever partitions than elements (%d vs %d)!\n",
+	   partitions,noelements);
+    bigerror("Partitioning not performed");
+  }
+
+  if(info) printf("Making a %s curve partitioning for %d elements in %d-dimensions.\n",
+		  hilbert ? "Hilbert" : "Morton",noelements,dim);
+
+  if(!data->partitionexist) {
+    data->partitionexist = TRUE;
+    data->elempart = Ivector(1,noelements);
+    data->nodepart = Ivector(1,noknots);
+    data->nopartitions = partitions;
+  }
+  elempart = data->elempart;
+
+  cx = Rvector(1,noelements);
+  cy = Rvector(1,noelements);
+  cz = Rvector(1,noelements);
+  weight = Ivector(1,noelements);
+
+  /* Element centroids and weights */
+#pragma omp parallel for private(j,k)
+  for(i=1;i<=noelements;i++) {
+    int nonodes;
+    Real x,y,z;
+    nonodes = data->elementtypes[i]%100;
+    x = y = z = 0.0;
+    for(j=0;j<nonodes;j++) {
+      k = data->topology[i][j];
+      x += data->x[k];
+      y += data->y[k];
+      if(dim==3) z += data->z[k];
+    }
+    cx[i] = x / nonodes;
+    cy[i] = y / nonodes;
+    cz[i] = z / nonodes;
+    weight[i] = weighted ? nonodes : 1;
+  }
+
+  mincoord[0] = maxcoord[0] = cx[1];
+  mincoord[1] = maxcoord[1] = cy[1];
+  mincoord[2] = maxcoord[2] = cz[1];
+  for(i=1;i<=noelements;i++) {
+    mincoord[0] = MIN(mincoord[0],cx[i]);
+    maxcoord[0] = MAX(maxcoord[0],cx[i]);
+    mincoord[1] = MIN(mincoord[1],cy[i]);
+    maxcoord[1] = MAX(maxcoord[1],cy[i]);
+    mincoord[2] = MIN(mincoord[2],cz[i]);
+    maxcoord[2] = MAX(maxcoord[2],cz[i]);
+  }
+
+  /* Use the same scaling in all directions to keep the curve cells cubic */
+  scale = 0.0;
+  for(j=0;j<dim;j++) 
+    scale = MAX(scale,maxcoord[j]-mincoord[j]);
+  if(scale <= 0.0) scale = 1.0;
+  bits = (dim == 3) ? 21 : 31;
+  scale = ((1u << bits) - 1) / scale;
+
+  key = (unsigned long long*) malloc((size_t) noelements*sizeof(unsigned long long));
+  key2 = (unsigned long long*) malloc((size_t) noelements*sizeof(unsigned long long));
+  indx = (int*) malloc((size_t) noelements*sizeof(int));
+  indx2 = (int*) malloc((size_t) noelements*sizeof(int));
+  if(!key || !key2 || !indx || !indx2) 
+    bigerror("PartitionSpaceFillingCurve: allocation of the sort keys failed");
+
+#pragma omp parallel for
+  for(i=0;i<noelements;i++) {
+    unsigned int X[3];
+    X[0] = (unsigned int) (scale * (cx[i+1]-mincoord[0]));
+    X[1] = (unsigned int) (scale * (cy[i+1]-mincoord[1]));
+    X[2] = (unsigned int) (scale * (cz[i+1]-mincoord[2]));
+    key[i] = SfcKey(X,MAX(dim,1),bits,hilbert && dim > 1);
+    indx[i] = i+1;
+  }
+
+  free_Rvector(cx,1,noelements);
+  free_Rvector(cy,1,noelements);
+  free_Rvector(cz,1,noelements);
+
+  SfcRadixSort(noelements,MAX(dim,1)*bits,key,indx,key2,indx2);
+
+  /* Cut the curve into pieces of equal weight */
+  totweight = 0;
+  for(i=1;i<=noelements;i++) 
+    totweight += weight[i];
+  cumweight = 0;
+  for(i=0;i<noelements;i++) {
+    k = indx[i];
+    part = (int) (((2*cumweight + weight[k]) * partitions) / (2*totweight)) + 1;
+    elempart[k] = MIN(part,partitions);
+    cumweight += weight[k];
+  }
+
+  free(key);
+  free(key2);
+  free(indx);
+  free(indx2);
+
+  RepairPartitionConnectivity(data,weight,info);
+
+  partweight = Ivector(1,partitions);
+  for(i=1;i<=partitions;i++) 
+    partweight[i] = 0;
+  for(i=1;i<=noelements;i++) 
+    partweight[elempart[i]] += weight[i];
+  minpart = maxpart = partweight[1];
+  for(i=1;i<=partitions;i++) {
+    minpart = MIN( partweight[i], minpart );
+    maxpart = MAX( partweight[i], maxpart );
+  }
+  free_Ivector(weight,1,noelements);
+
+  PartitionNodesByElements(data,info);
+
+  if(info) {
+    int *invrow,*invcol,shared;
+    invrow = data->invtopo.rows;
+    invcol = data->invtopo.cols;
+    shared = 0;
+    for(i=1;i<=noknots;i++) {
+      for(j=invrow[i-1];j<invrow[i];j++) {
+	if(elempart[invcol[j]+1] != elempart[invcol[invrow[i-1]]+1]) {
+	  shared++;
+	  break;
+	}
+      }
+    }
+    printf("Element weight in partitions from %d to %d (imbalance %.3f)\n",minpart,maxpart,
+	   (double) maxpart * partitions / totweight);
+    printf("There are %d nodes (%.2f %%) at the partition interfaces\n",shared,
+	   100.0 * shared / noknots);
+    printf("Successfully made a space-filling curve partitioning.\n");
+  }
+  free_Ivector(partweight,1,partitions);
+
+  return(0);
+}
+
+
+
 int PartitionMetisMesh(struct FemType *data,struct ElmergridType *eg,
 		       int partitions,int dual,int info)
 /* Perform partitioning using Metis. This uses the elemental routines of Metis that assume that 
@@ -4618,6 +5308,9 @@ int SaveElmerInputPartitioned(struct FemType *data,struct BoundaryType *bound,
   int *bcnodedummy,*elementhalo,*neededtimes2;
   int partstart,partfin,filesetsize,nofile,nofile2;
   int halobulkelems,halobcs;
+  int c,step,totsides,sideoffset[MAXBOUNDARIES],*sidebc,*sidelist,*sideptr,*sidemark;
+  int *partptr,*partlist;
+  Real stagetime;
   FILE *out,*outfiles[MAXPARTITIONS+1];
   int sumelementsinpart,sumownnodes,sumsharednodes,sumsidesinpart,sumorphannodes,sumindirect;
 
@@ -4626,6 +5319,7 @@ int SaveElmerInputPartitioned(struct FemType *data,struct BoundaryType *bound,
     if( halomode ) printf("Saving halo elements in mode %d\n",halomode);
     if( subparts ) printf("There are %d subpartitions\n",subparts);
   }
+  stagetime = WallTime();
 
   if(!data->created) {
     printf("You tried to save points that were never created.\n");
@@ -4667,14 +5361,18 @@ int SaveElmerInputPartitioned(struct FemType *data,struct BoundaryType *bound,
      This feature was coded for collaboration with Hypre library that assumes this. */
   reorder = parthypre;
   if(reorder) {
+    /* Counting sort of the nodes by the owner partition */
     order = Ivector(1,noknots);
-    k = 0;
+    partptr = Ivector(1,partitions+1);
+    for(j=1;j<=partitions+1;j++)
+      partptr[j] = 0;
+    for(i=1; i <= noknots; i++) 
+      partptr[ownerpart[i]+1] += 1;
     for(j=1;j<=partitions;j++)
-      for(i=1; i <= noknots; i++) 
-	if(ownerpart[i] == j) {
-	  k++;
-	  order[i] = k; 
-	}
+      partptr[j+1] += partptr[j];
+    for(i=1; i <= noknots; i++) 
+      order[i] = ++partptr[ownerpart[i]];
+    free_Ivector(partptr,1,partitions+1);
     invorder = Ivector(1,noknots);
     for(i=1;i<=noknots;i++) 
       invorder[order[i]] = i;
@@ -4752,9 +5450,54 @@ int SaveElmerInputPartitioned(struct FemType *data,struct BoundaryType *bound,
   /*********** part.n.elements *********************/
   /* Save elements in all partitions and where they are needed */
 
-  
-  partstart = 1;
-  partfin = MIN( partitions, filesetsize );
+  /* Without halo each element is saved only in its own partition. The elements 
+     are then sorted by partition and the partitions are saved independently. */
+  if(!halomode) {
+    partptr = Ivector(1,partitions+1);
+    partlist = Ivector(0,MAX(noelements,1)-1);
+    for(part=1;part<=partitions+1;part++)
+      partptr[part] = 0;
+    for(i=1;i<=noelements;i++) 
+      partptr[elempart[i]+1] += 1;
+    for(part=1;part<=partitions;part++)
+      partptr[part+1] += partptr[part];
+    for(i=1;i<=noelements;i++) 
+      partlist[partptr[elempart[i]]++] = i;
+    for(part=partitions;part>=1;part--)
+      partptr[part+1] = partptr[part];
+    partptr[1] = 0;
+
+#pragma omp parallel for private(i,j,k,ind,elemtype,nodesd2,filename,out) schedule(dynamic,1)
+    for(part=1;part<=partitions;part++) {
+      sprintf(filename,"%s.%d.%s","part",part,"elements");
+      out = fopen(filename,"w");
+      setvbuf(out,NULL,_IOFBF,PARTBUFSIZE);
+
+      for(k=partptr[part];k<partptr[part+1];k++) {
+	i = partlist[k];
+	elemtype = data->elementtypes[i];
+	nodesd2 = elemtype%100;
+
+	bulktypes[part][elemtype] += 1;
+	elementsinpart[part] += 1;
+
+	fprintf(out,"%d %d %d ",i,data->material[i],elemtype);
+	for(j=0;j < nodesd2;j++) {
+	  ind = data->topology[i][j];
+	  if(reorder) ind = order[ind];
+	  fprintf(out,"%d ",ind);
+	}
+	fprintf(out,"\n");    
+      }
+      fclose(out);
+    }
+    free_Ivector(partptr,1,partitions+1);
+    free_Ivector(partlist,0,MAX(noelements,1)-1);
+    goto elements_saved;
+  }
+  
+  partstart = 1;
+  partfin = MIN( partitions, filesetsize );
 
  next_elements_set:
 
@@ -5010,7 +5753,11 @@ int SaveElmerInputPartitioned(struct FemType *data,struct BoundaryType *bound,
     partfin = MIN( partfin + filesetsize, partitions);
     goto next_elements_set;
   }
+
+ elements_saved:
   /* part.n.elements saved */
+  if(info) printf("Saved the elements of the partitions in %.2f s\n",WallTime()-stagetime);
+  stagetime = WallTime();
 
 
   /* The partitiontable has been changed to include the halo elements. The need for saving the 
@@ -5064,9 +5811,37 @@ int SaveElmerInputPartitioned(struct FemType *data,struct BoundaryType *bound,
 
 
   /*********** part.n.nodes *********************/
+  /*********** part.n.shared *********************/
 
-  partstart = 1;
-  partfin = MIN( partitions, filesetsize);
+  /* List the nodes of each partition in the saving order in one pass 
+     over the partition table. Then the partitions are independent. */
+  partptr = Ivector(1,partitions+1);
+  for(part=1;part<=partitions+1;part++)
+    partptr[part] = 0;
+  for(l=1; l <= noknots; l++) {      
+    i = l;
+    if(reorder) i=invorder[l];
+    for(j=1;j<=maxneededtimes;j++) {
+      k = data->partitiontable[j][i];
+      if(!k) break;
+      partptr[k+1] += 1;
+    }
+  }
+  for(part=1;part<=partitions;part++)
+    partptr[part+1] += partptr[part];
+  partlist = Ivector(0,MAX(partptr[partitions+1],1)-1);
+  for(l=1; l <= noknots; l++) {      
+    i = l;
+    if(reorder) i=invorder[l];
+    for(j=1;j<=maxneededtimes;j++) {
+      k = data->partitiontable[j][i];
+      if(!k) break;
+      partlist[partptr[k]++] = i;
+    }
+  }
+  for(part=partitions;part>=1;part--)
+    partptr[part+1] = partptr[part];
+  partptr[1] = 0;
 
   for(i=1;i<=partitions;i++) {
     needednodes[i] = 0;
@@ -5075,101 +5850,55 @@ int SaveElmerInputPartitioned(struct FemType *data,struct BoundaryType *bound,
     ownnodes[i] = 0;
   }    
 
- next_nodes_set:
-
-  for(part=partstart;part<=partfin;part++) {
+#pragma omp parallel for private(i,k,m,ind,filename,out) schedule(dynamic,1)
+  for(part=1;part<=partitions;part++) {
     sprintf(filename,"%s.%d.%s","part",part,"nodes");
-    nofile = part - partstart + 1;
-    outfiles[nofile] = fopen(filename,"w");
-  }
-  
-  for(l=1; l <= noknots; l++) {      
-    i = l;
-    if(reorder) i=invorder[l];
-
-    /*    for(j=1;j<=neededtimes2[i];j++) { */
-    for(j=1;j<=maxneededtimes;j++) {
-
-      k = data->partitiontable[j][i];
-      if(!k) break;
-
-      if(k < partstart || k > partfin) continue;
-      nofile = k - partstart + 1;
+    out = fopen(filename,"w");
+    setvbuf(out,NULL,_IOFBF,PARTBUFSIZE);
 
+    for(k=partptr[part];k<partptr[part+1];k++) {
+      i = partlist[k];
       ind = i;
       if(reorder) ind=order[i];
 
       if(data->dim == 2)
-	fprintf(outfiles[nofile],outstyle,ind,-1,data->x[i],data->y[i]);
+	fprintf(out,outstyle,ind,-1,data->x[i],data->y[i]);
       else if(data->dim == 3)
-	fprintf(outfiles[nofile],outstyle,ind,-1,data->x[i],data->y[i],data->z[i]);	  	    
+	fprintf(out,outstyle,ind,-1,data->x[i],data->y[i],data->z[i]);	  	    
       
-      needednodes[k] += 1;
-      if(k == ownerpart[i]) 
-	ownnodes[k] += 1;
+      needednodes[part] += 1;
+      if(part == ownerpart[i]) 
+	ownnodes[part] += 1;
       else 
-	sharednodes[k] += 1;
+	sharednodes[part] += 1;
     }
-  }
-
-  for(part=partstart;part<=partfin;part++) {
-    nofile = part - partstart + 1;
-    fclose(outfiles[nofile]);
-  }
-  if(partfin < partitions) {
-    partstart = partfin + 1;
-    partfin = MIN( partfin + filesetsize, partitions);
-    goto next_nodes_set;
-  }
-  /* part.n.nodes saved */
-      
-
-  /*********** part.n.shared *********************/
-
-  partstart = 1;
-  partfin = MIN( partitions, filesetsize );
-
- next_shared_set:
+    fclose(out);
 
-  for(part=partstart;part<=partfin;part++) {
     sprintf(filename,"%s.%d.%s","part",part,"shared");
-    nofile = part - partstart + 1;
-    outfiles[nofile] = fopen(filename,"w");
-  }
-
-  for(l=1; l <= noknots; l++) {      
-    i = l;
-    if(reorder) i = invorder[l];
+    out = fopen(filename,"w");
+    setvbuf(out,NULL,_IOFBF,PARTBUFSIZE);
 
-    if(neededtimes2[i] <= 1) continue;
-
-    for(j=1;j<=neededtimes2[i];j++) {
-      k = data->partitiontable[j][i];
-      
-      if(k < partstart || k > partfin) continue;
-      nofile = k - partstart + 1;
+    for(k=partptr[part];k<partptr[part+1];k++) {
+      i = partlist[k];
+      if(neededtimes2[i] <= 1) continue;
 
       ind = i;
       if(reorder) ind = order[i];
-      neededtwice[k] += 1; 
+      neededtwice[part] += 1; 
 
-      fprintf(outfiles[nofile],"%d %d %d",ind,neededtimes2[i],ownerpart[i]);      
+      fprintf(out,"%d %d %d",ind,neededtimes2[i],ownerpart[i]);      
       for(m=1;m<=neededtimes2[i];m++) 
-	if(data->partitiontable[m][i] != ownerpart[i]) fprintf(outfiles[nofile]," %d",data->partitiontable[m][i]);
-      fprintf(outfiles[nofile],"\n");
+	if(data->partitiontable[m][i] != ownerpart[i]) fprintf(out," %d",data->partitiontable[m][i]);
+      fprintf(out,"\n");
     }
+    fclose(out);
   }
 
-  for(part=partstart;part<=partfin;part++) {
-    nofile = part - partstart + 1;
-    fclose(outfiles[nofile]);
-  }
-  if(partfin < partitions) {
-    partstart = partfin + 1;
-    partfin = MIN( partfin + filesetsize, partitions);
-    goto next_shared_set;
-  }
-  /* part.n.shared saved */
+  free_Ivector(partlist,0,MAX(partptr[partitions+1],1)-1);
+  free_Ivector(partptr,1,partitions+1);
+  /* part.n.nodes and part.n.shared saved */
+  if(info) printf("Saved the nodes of the partitions in %.2f s\n",WallTime()-stagetime);
+  stagetime = WallTime();
 
 
 
@@ -5183,15 +5912,71 @@ int SaveElmerInputPartitioned(struct FemType *data,struct BoundaryType *bound,
   discont = FALSE;
   splitsides = 0;
 
+  for(i=1;i<=noknots;i++)
+    bcnodesaved[i] = bcnodesaved2[i] = FALSE;
+
+  /* List for each partition the boundary elements that have some of their nodes 
+     in it. Other boundary elements are never saved to the partition. */
+  totsides = 0;
+  for(j=0;j < MAXBOUNDARIES;j++) {
+    sideoffset[j] = totsides - 1;
+    totsides += bound[j].nosides;
+  }
+  sidebc = Ivector(0,MAX(totsides,1)-1);
+  sidemark = Ivector(1,partitions);
+  sideptr = Ivector(1,partitions+1);
+  for(part=1;part<=partitions+1;part++)
+    sideptr[part] = 0;
+  sidelist = NULL;
+
+  for(step=1;step<=2;step++) {
+    for(part=1;part<=partitions;part++)
+      sidemark[part] = -1;
+    for(j=0;j < MAXBOUNDARIES;j++) {
+      for(i=1; i <= bound[j].nosides; i++) {
+	c = sideoffset[j] + i;
+	sidebc[c] = j;
+	GetElementSide(bound[j].parent[i],bound[j].side[i],bound[j].normal[i],
+		       data,sideind,&sideelemtype);
+	for(l=0;l<sideelemtype%100;l++) {
+	  ind = sideind[l];
+	  for(k=1;k<=neededtimes[ind];k++) {
+	    part = data->partitiontable[k][ind];
+	    if(sidemark[part] == c) continue;
+	    sidemark[part] = c;
+	    if(step == 1) 
+	      sideptr[part+1] += 1;
+	    else
+	      sidelist[sideptr[part]++] = c;
+	  }
+	}
+      }
+    }
+    if(step == 1) {
+      for(part=1;part<=partitions;part++)
+	sideptr[part+1] += sideptr[part];
+      sidelist = Ivector(0,MAX(sideptr[partitions+1],1)-1);
+    }
+    else {
+      for(part=partitions;part>=1;part--)
+	sideptr[part+1] = sideptr[part];
+      sideptr[1] = 0;
+    }
+  }
+
   halobcs = 0;
   for(part=1;part<=partitions;part++) { 
     int bcneeded2,step,closeparent,closeparent2;
 
     sprintf(filename,"%s.%d.%s","part",part,"boundary");
     out = fopen(filename,"w");
+    setvbuf(out,NULL,_IOFBF,PARTBUFSIZE);
 
-    for(i=1;i<=noknots;i++)
-      bcnodesaved[i] = bcnodesaved2[i] = FALSE;
+    /* The indirect connections below use the same vector */
+    if(indirect) {
+      for(i=1;i<=noknots;i++)
+	bcnodesaved[i] = bcnodesaved2[i] = FALSE;
+    }
    
     for(i=minelemtype;i<=maxelemtype;i++)
       sidetypes[i] = 0;
@@ -5200,178 +5985,177 @@ int SaveElmerInputPartitioned(struct FemType *data,struct BoundaryType *bound,
 
     /* First loop the standard elements, 2nd time the orphan nodes */
     for(step=1;step<=2;step++) {
-      for(j=0;j < MAXBOUNDARIES;j++) {
-      
-	/* Normal boundary conditions */
-	for(i=1; i <= bound[j].nosides; i++) {
+      /* Normal boundary conditions having some nodes in this partition */
+      for(c=sideptr[part];c<sideptr[part+1];c++) {
+	j = sidebc[sidelist[c]];
+	i = sidelist[c] - sideoffset[j];
 	  
-	  GetElementSide(bound[j].parent[i],bound[j].side[i],bound[j].normal[i],
-			 data,sideind,&sideelemtype);
-	  bctype = bound[j].types[i];
-	  nodesd1 = sideelemtype%100;
+	GetElementSide(bound[j].parent[i],bound[j].side[i],bound[j].normal[i],
+		       data,sideind,&sideelemtype);
+	bctype = bound[j].types[i];
+	nodesd1 = sideelemtype%100;
 	  
-	  bcneeded = 0;
+	bcneeded = 0;
+	for(l=0;l<nodesd1;l++) {
+	  ind = sideind[l];
+	  for(k=1;k<=neededtimes[ind];k++)
+	    if(part == data->partitiontable[k][ind]) bcneeded++;	   
+	}
+	if(!bcneeded) continue;
+
+	bcneeded2 = bcneeded;
+	if( halomode ) {
 	  for(l=0;l<nodesd1;l++) {
 	    ind = sideind[l];
-	    for(k=1;k<=neededtimes[ind];k++)
-	      if(part == data->partitiontable[k][ind]) bcneeded++;	   
-	  }
-	  if(!bcneeded) continue;
-
-	  bcneeded2 = bcneeded;
-	  if( halomode ) {
-	    for(l=0;l<nodesd1;l++) {
-	      ind = sideind[l];
-	      for(k=neededtimes[ind]+1;k<=neededtimes2[ind];k++)	      
-		if(part == data->partitiontable[k][ind]) bcneeded2++;
-	    }
+	    for(k=neededtimes[ind]+1;k<=neededtimes2[ind];k++)	      
+	      if(part == data->partitiontable[k][ind]) bcneeded2++;
 	  }
+	}
 
-	  parent = bound[j].parent[i];
-	  parent2 = bound[j].parent2[i];
-
-	  /* Check whether the side is such that it belongs to the domain */
-	  if( parent )
-	    trueparent = (elempart[parent] == part);
-	  else 
-	    trueparent = FALSE;
-
-	  if( parent2 ) 
-	    trueparent2 = (elempart[parent2] == part);
-	  else
-	    trueparent2 = FALSE;
-
-	  if( halomode == 3 ) {
-	    closeparent = closeparent2 = FALSE;
-	    if( part <= subparts ) {
-	      if( parent ) 
-		if( elempart[parent] <= subparts) 
-		  closeparent = ( ABS( elempart[parent]-part) == 1 );
-	      if( parent2 ) 
-		if( elempart[parent2] <= subparts ) 
-		  closeparent2 = ( ABS( elempart[parent2]-part) == 1 );
-	    }
+	parent = bound[j].parent[i];
+	parent2 = bound[j].parent2[i];
+
+	/* Check whether the side is such that it belongs to the domain */
+	if( parent )
+	  trueparent = (elempart[parent] == part);
+	else 
+	  trueparent = FALSE;
+
+	if( parent2 ) 
+	  trueparent2 = (elempart[parent2] == part);
+	else
+	  trueparent2 = FALSE;
+
+	if( halomode == 3 ) {
+	  closeparent = closeparent2 = FALSE;
+	  if( part <= subparts ) {
+	    if( parent ) 
+	      if( elempart[parent] <= subparts) 
+		closeparent = ( ABS( elempart[parent]-part) == 1 );
+	    if( parent2 ) 
+	      if( elempart[parent2] <= subparts ) 
+		closeparent2 = ( ABS( elempart[parent2]-part) == 1 );
 	  }
+	}
 
 
-	  if( step == 1 ) {
+	if( step == 1 ) {
 
-	    /* Halo elements ensure that both parents exist even if they are not trueparents */
-	    if(halomode == 1 || halomode == 2) {
-	      if( bcneeded2 < nodesd1 ) {
-		if( halomode == 2 ) {
-		  printf("Warning: side element %d of type %d is halo but nodes are not in partition: %d %d\n",
-			 i,sideelemtype,bcneeded2,nodesd1);
-		}
-		continue;
+	  /* Halo elements ensure that both parents exist even if they are not trueparents */
+	  if(halomode == 1 || halomode == 2) {
+	    if( bcneeded2 < nodesd1 ) {
+	      if( halomode == 2 ) {
+		printf("Warning: side element %d of type %d is halo but nodes are not in partition: %d %d\n",
+		       i,sideelemtype,bcneeded2,nodesd1);
 	      }
-	      if(!trueparent && !trueparent2) halobcs += 1;
+	      continue;
 	    }
-	    else if( halomode == 3 ) {
-	      if(!(trueparent || trueparent2 || closeparent || closeparent2 )) continue;
-	      if(!trueparent && !trueparent2) halobcs += 1;
-	    }
-	    else {	     
-	      /* Either parent must be associated with this partition, otherwise do not save this */
-	      if(!trueparent && !trueparent2) continue;
+	    if(!trueparent && !trueparent2) halobcs += 1;
+	  }
+	  else if( halomode == 3 ) {
+	    if(!(trueparent || trueparent2 || closeparent || closeparent2 )) continue;
+	    if(!trueparent && !trueparent2) halobcs += 1;
+	  }
+	  else {	     
+	    /* Either parent must be associated with this partition, otherwise do not save this */
+	    if(!trueparent && !trueparent2) continue;
 
-	      if( parent && !trueparent ) {	  
-		splitsides++;
-		parent = 0;
-	      }
-	      else if( parent2 && !trueparent2 ) {
-		splitsides++;
-		parent2 = 0;
-	      }
+	    if( parent && !trueparent ) {	  
+	      splitsides++;
+	      parent = 0;
 	    }
+	    else if( parent2 && !trueparent2 ) {
+	      splitsides++;
+	      parent2 = 0;
+	    }
+	  }
 	    
-	    if(bound[j].ediscont) 
-	      discont = bound[j].discont[i];
+	  if(bound[j].ediscont) 
+	    discont = bound[j].discont[i];
 
-	    sumsides++;	
-	    sidetypes[sideelemtype] += 1;
+	  sumsides++;	
+	  sidetypes[sideelemtype] += 1;
 	    
-	    if( trueparent ) 
-	      fprintf(out,"%d %d %d %d %d",
-		      sumsides,bctype,parent,parent2,sideelemtype);	  
-	    else if( trueparent2 ) 
-	      fprintf(out,"%d %d %d %d %d",
-		      sumsides,bctype,parent2,parent,sideelemtype);	  
-	    else  /* this is only reached for halomode */
-	      fprintf(out,"%d/%d %d %d %d %d",
-		      sumsides,elempart[parent],bctype,parent,parent2,sideelemtype);	    
-	    if(reorder) {
-	      for(l=0;l<nodesd1;l++)
-		fprintf(out," %d",order[sideind[l]]);
-	    } else {
-	      for(l=0;l<nodesd1;l++)
-		fprintf(out," %d",sideind[l]);	  
-	    }
-	    fprintf(out,"\n");
+	  if( trueparent ) 
+	    fprintf(out,"%d %d %d %d %d",
+		    sumsides,bctype,parent,parent2,sideelemtype);	  
+	  else if( trueparent2 ) 
+	    fprintf(out,"%d %d %d %d %d",
+		    sumsides,bctype,parent2,parent,sideelemtype);	  
+	  else  /* this is only reached for halomode */
+	    fprintf(out,"%d/%d %d %d %d %d",
+		    sumsides,elempart[parent],bctype,parent,parent2,sideelemtype);	    
+	  if(reorder) {
+	    for(l=0;l<nodesd1;l++)
+	      fprintf(out," %d",order[sideind[l]]);
+	  } else {
+	    for(l=0;l<nodesd1;l++)
+	      fprintf(out," %d",sideind[l]);	  
+	  }
+	  fprintf(out,"\n");
 
-	    /* Memorize that the node has already been saved as a regular BC. */
-	    for(l=0;l<nodesd1;l++) {
-	      k = sideind[l];
-	      if(bcnodesaved[k] == bctype || bcnodesaved2[k] == bctype ) continue;
+	  /* Memorize that the node has already been saved as a regular BC. */
+	  for(l=0;l<nodesd1;l++) {
+	    k = sideind[l];
+	    if(bcnodesaved[k] == bctype || bcnodesaved2[k] == bctype ) continue;
 	      
-	      if(!bcnodesaved[k]) 
-		bcnodesaved[k] = bctype;
-	      else if(!bcnodesaved2[k]) 
-		bcnodesaved2[k] = bctype;
-	      else 
-		if(0) printf("Node %d shared by more than two BCs (%d)\n",k,bctype);
-	    }
+	    if(!bcnodesaved[k]) 
+	      bcnodesaved[k] = bctype;
+	    else if(!bcnodesaved2[k]) 
+	      bcnodesaved2[k] = bctype;
+	    else 
+	      if(0) printf("Node %d shared by more than two BCs (%d)\n",k,bctype);
+	  }
+	}
+	else if( step == 2 ) {
+	  /* These are orphan nodes that are saved as 101 points and may be given 
+	     Dirichlet conditions in the code. If the node is already saved in respect to 
+	     this partition no saving is done. */
+
+	  /* This partition must own at least one of the nodes so that this could be a problem,
+	     but not all the nodes */
+	  if(bcneeded == nodesd1) continue;
+
+	  /* For halo elements some additional BC elements have been saved */
+	  if( halomode == 1 || halomode == 2) {
+	    if( bcneeded2 == nodesd1 ) continue;
+	  }
+	  /* For layer halo the BCs in the closeby partition have been saved */
+	  else if( halomode == 3 ) {
+	    if( closeparent || closeparent2 ) continue;
 	  }
-	  else if( step == 2 ) {
-	    /* These are orphan nodes that are saved as 101 points and may be given 
-	       Dirichlet conditions in the code. If the node is already saved in respect to 
-	       this partition no saving is done. */
-
-	    /* This partition must own at least one of the nodes so that this could be a problem,
-	       but not all the nodes */
-	    if(bcneeded == nodesd1) continue;
-
-	    /* For halo elements some additional BC elements have been saved */
-	    if( halomode == 1 || halomode == 2) {
-	      if( bcneeded2 == nodesd1 ) continue;
-	    }
-	    /* For layer halo the BCs in the closeby partition have been saved */
-	    else if( halomode == 3 ) {
-	      if( closeparent || closeparent2 ) continue;
-	    }
 
-	    /* Check whether the side is such that it belongs to the domain,
-	       if it does it cannot be an orphan node. */
-	    if( trueparent || trueparent2 ) continue;
+	  /* Check whether the side is such that it belongs to the domain,
+	     if it does it cannot be an orphan node. */
+	  if( trueparent || trueparent2 ) continue;
 		         
-	    for(l=0;l<nodesd1;l++) {
-	      ind = sideind[l];
-	      for(k=1;k<=neededtimes[ind];k++)
-		if(part == data->partitiontable[k][ind]) {
+	  for(l=0;l<nodesd1;l++) {
+	    ind = sideind[l];
+	    for(k=1;k<=neededtimes[ind];k++)
+	      if(part == data->partitiontable[k][ind]) {
 		  
-		  /* Check whether the nodes was not already saved */
-		  if( bcnodesaved[ind] == bctype ) continue;	  
-		  if( bcnodesaved2[ind] == bctype ) continue;	  
+		/* Check whether the nodes was not already saved */
+		if( bcnodesaved[ind] == bctype ) continue;	  
+		if( bcnodesaved2[ind] == bctype ) continue;	  
 		  
-		  /* Memorize if the node really was saved. */
-		  if(!bcnodesaved[ind]) 
-		    bcnodesaved[ind] = bctype;
-		  else if(!bcnodesaved2[ind]) 
-		    bcnodesaved2[ind] = bctype;
+		/* Memorize if the node really was saved. */
+		if(!bcnodesaved[ind]) 
+		  bcnodesaved[ind] = bctype;
+		else if(!bcnodesaved2[ind]) 
+		  bcnodesaved2[ind] = bctype;
 		  
-		  orphannodes[part] += 1;
+		orphannodes[part] += 1;
 		  
-		  sumsides++;
-		  sidetypes[101] += 1;
+		sumsides++;
+		sidetypes[101] += 1;
 		  
-		  if(reorder) {
-		    fprintf(out,"%d %d 0 0 101 %d\n",sumsides,bctype,order[ind]);
-		  }
-		  else {
-		    fprintf(out,"%d %d 0 0 101 %d\n",sumsides,bctype,ind);
-		  }	  
+		if(reorder) {
+		  fprintf(out,"%d %d 0 0 101 %d\n",sumsides,bctype,order[ind]);
 		}
-	    }
+		else {
+		  fprintf(out,"%d %d 0 0 101 %d\n",sumsides,bctype,ind);
+		}	  
+	      }
 	  }
 	}
       }
@@ -5382,6 +6166,7 @@ int SaveElmerInputPartitioned(struct FemType *data,struct BoundaryType *bound,
     /* The second side for discontinuous boundary conditions.
        Note that this has not been treated for orphan control. */
     for(j=0;j < MAXBOUNDARIES;j++) {
+      if(!bound[j].ediscont) continue;
       for(i=1; i <= bound[j].nosides; i++) {
 	if(bound[j].ediscont) 
 	  discont = bound[j].discont[i];
@@ -5426,6 +6211,18 @@ int SaveElmerInputPartitioned(struct FemType *data,struct BoundaryType *bound,
       }
     }
     sidesinpart[part] = sumsides;
+
+    /* Clear the marks of the nodes that were saved for this partition */
+    if(!indirect) {
+      for(c=sideptr[part];c<sideptr[part+1];c++) {
+	j = sidebc[sidelist[c]];
+	i = sidelist[c] - sideoffset[j];
+	GetElementSide(bound[j].parent[i],bound[j].side[i],bound[j].normal[i],
+		       data,sideind,&sideelemtype);
+	for(l=0;l<sideelemtype%100;l++) 
+	  bcnodesaved[sideind[l]] = bcnodesaved2[sideind[l]] = FALSE;
+      }
+    }
         
 
     /* Boundary nodes that express indirect couplings between different partitions.
@@ -5650,6 +6447,7 @@ int SaveElmerInputPartitioned(struct FemType *data,struct BoundaryType *bound,
     }
   }
   /*********** end of part.n.header *********************/
+  if(info) printf("Saved the boundaries of the partitions in %.2f s\n",WallTime()-stagetime);
   
   sumelementsinpart = sumownnodes = sumsharednodes = sumsidesinpart = sumorphannodes = sumindirect = 0;
   for(i=1;i<=partitions;i++) {
@@ -5681,6 +6479,10 @@ int SaveElmerInputPartitioned(struct FemType *data,struct BoundaryType *bound,
 
   free_Ivector(bcnodesaved2,1,noknots);
   if(halomode) free_Ivector(neededtimes2,1,noknots);
+  free_Ivector(sidelist,0,MAX(sideptr[partitions+1],1)-1);
+  free_Ivector(sideptr,1,partitions+1);
+  free_Ivector(sidemark,1,partitions);
+  free_Ivector(sidebc,0,MAX(totsides,1)-1);
   
   
   chdir("..");
@@ -5701,6 +6503,400 @@ int SaveElmerInputPartitioned(struct FemType *data,struct BoundaryType *bound,
 }
 
 
+static int CompareIntegers(const void *a,const void *b)
+{
+  return( *(const int*)a - *(const int*)b );
+}
+
+
+static void CreateNodalGraphCRS(struct FemType *data,int diag,int **prows,int **pcols)
+/* Creates the 0-based CRS graph of the nodes sharing an element, 
+   with the columns of each row in increasing order. The columns are 
+   allocated with malloc and the rows with Ivector. */
+{
+  int i,j,e,n,ind,nonodes,noknots,noelements,totcon,maxcon,totinv;
+  int *invrow,*invcol,*rows,*cols,*mark;
+
+  noknots = data->noknots;
+  noelements = data->noelements;
+
+  /* Inverse topology from nodes to elements */
+  invrow = Ivector(0,noknots+1);
+  for(i=0;i<=noknots+1;i++) invrow[i] = 0;
+  for(e=1;e<=noelements;e++) 
+    for(j=0;j<data->elementtypes[e]%100;j++) 
+      invrow[data->topology[e][j]] += 1;
+  for(i=1;i<=noknots;i++) 
+    invrow[i] += invrow[i-1];
+  totinv = invrow[noknots];
+  invrow[noknots+1] = totinv;
+  invcol = Ivector(0,MAX(totinv,1)-1);
+  for(e=noelements;e>=1;e--) {
+    for(j=0;j<data->elementtypes[e]%100;j++) {
+      n = data->topology[e][j];
+      invrow[n] -= 1;
+      invcol[invrow[n]] = e;
+    }
+  }
+
+  mark = Ivector(1,noknots);
+  for(i=1;i<=noknots;i++) mark[i] = 0;
+  rows = Ivector(0,noknots);
+
+  /* The connections are set in one sweep. The table is enlarged as needed 
+     starting from a guess that is enough for most meshes. */
+  maxcon = MAX(4*totinv,noknots+1);
+  cols = (int*) malloc((size_t) maxcon*sizeof(int));
+  totcon = 0;
+  for(i=1;i<=noknots;i++) {
+    rows[i-1] = totcon;
+    for(j=invrow[i];j<invrow[i+1];j++) {
+      e = invcol[j];
+      nonodes = data->elementtypes[e]%100;
+      if(totcon + nonodes > maxcon) {
+	maxcon = 2*maxcon;
+	cols = (int*) realloc(cols,(size_t) maxcon*sizeof(int));
+      }
+      for(n=0;n<nonodes;n++) {
+	ind = data->topology[e][n];
+	if(mark[ind] == i || (!diag && ind == i)) continue;
+	mark[ind] = i;
+	cols[totcon++] = ind-1;
+      }
+    }
+    qsort(cols+rows[i-1],totcon-rows[i-1],sizeof(int),CompareIntegers);
+  }
+  rows[noknots] = totcon;
+
+  free_Ivector(invrow,0,noknots+1);
+  free_Ivector(invcol,0,MAX(totinv,1)-1);
+  free_Ivector(mark,1,noknots);
+
+  *prows = rows;
+  *pcols = cols;
+}
+
+
+int BenchmarkNodalGraph(struct FemType *data,int info)
+/* Reports the bandwidth of the nodal graph and the time of a matrix-vector 
+   product in CRS format with the sparsity of a nodal finite element matrix. 
+   This gives an idea of the effect of the node ordering before running the solver. */
+{
+  int i,j,k,noknots,nnz,bandwidth,reps,rep;
+  int *rows,*cols;
+  double *vals,*x,*y,sumdist,t0,t,sum;
+
+  noknots = data->noknots;
+  if(noknots < 1) return(1);
+
+  CreateNodalGraphCRS(data,TRUE,&rows,&cols);
+  nnz = rows[noknots];
+
+  bandwidth = 0;
+  sumdist = 0.0;
+  for(i=0;i<noknots;i++) {
+    for(j=rows[i];j<rows[i+1];j++) {
+      k = ABS(cols[j]-i);
+      bandwidth = MAX(bandwidth,k);
+      sumdist += k;
+    }
+  }
+
+  vals = (double*) malloc((size_t) nnz*sizeof(double));
+  x = (double*) malloc((size_t) noknots*sizeof(double));
+  y = (double*) malloc((size_t) noknots*sizeof(double));
+
+#pragma omp parallel for private(j)
+  for(i=0;i<noknots;i++) {
+    x[i] = 1.0 + 1.0e-3*(i%7);
+    for(j=rows[i];j<rows[i+1];j++) 
+      vals[j] = (cols[j] == i) ? rows[i+1]-rows[i] : -1.0;
+  }
+
+  /* Enough repetitions for a measurable time */
+  reps = MAX(3,(int) (2.0e8 / MAX(nnz,1)));
+  reps = MIN(reps,1000);
+
+  t0 = WallTime();
+  for(rep=0;rep<reps;rep++) {
+#pragma omp parallel for private(j,sum) schedule(static)
+    for(i=0;i<noknots;i++) {
+      sum = 0.0;
+      for(j=rows[i];j<rows[i+1];j++) 
+	sum += vals[j] * x[cols[j]];
+      y[i] = sum;
+    }
+    x[rep%noknots] += 1.0e-3*y[(rep*7)%noknots];
+  }
+  t = (WallTime() - t0) / reps;
+
+  if(info) {
+    printf("Nodal graph has %d nodes and %d entries, %.1f per row\n",noknots,nnz,(double) nnz/noknots);
+    printf("Bandwidth of the nodal graph is %d and the average distance %.1f\n",
+	   bandwidth,sumdist/nnz);
+    printf("CRS matrix-vector product takes %.3g ms (%.2f GFlop/s)\n",
+	   1.0e3*t,t > 0.0 ? 2.0e-9*nnz/t : 0.0);
+  }
+
+  free(vals);
+  free(x);
+  free(y);
+  free_Ivector(rows,0,noknots);
+  free(cols);
+
+  return(0);
+}
+
+
+static void OrderCuthillMckee(int n,int *rows,int *cols,int *perm)
+/* Reverse Cuthill-McKee ordering of a graph in CRS format. Each connected 
+   component is started from a pseudo-peripheral node. On return perm[new] = old. */
+{
+  int i,j,k,l,m,root,head,tail,first,nodeg,lastlevel,levels,newlevels,iter;
+  int *degree,*level,*done;
+
+  degree = Ivector(0,n-1);
+  level = Ivector(0,n-1);
+  done = Ivector(0,n-1);
+  for(i=0;i<n;i++) {
+    degree[i] = rows[i+1]-rows[i];
+    done[i] = FALSE;
+    level[i] = -1;
+  }
+
+  tail = 0;
+  for(i=0;i<n;i++) {
+    if(done[i]) continue;
+
+    /* Find a pseudo-peripheral node by repeated level structures. The level 
+       numbers are used as marks and reset after each search. */
+    root = i;
+    levels = 0;
+    for(iter=0;iter<5;iter++) {
+      first = tail;
+      head = tail;
+      perm[tail] = root;
+      level[root] = 0;
+      m = tail+1;
+      while(head < m) {
+	k = perm[head++];
+	for(j=rows[k];j<rows[k+1];j++) {
+	  l = cols[j];
+	  if(level[l] >= 0 || done[l]) continue;
+	  level[l] = level[k]+1;
+	  perm[m++] = l;
+	}
+      }
+      newlevels = level[perm[m-1]];
+
+      /* The node of minimum degree on the last level */
+      lastlevel = newlevels;
+      k = perm[m-1];
+      for(j=m-1;j>=first && level[perm[j]] == lastlevel;j--) 
+	if(degree[perm[j]] < degree[k]) k = perm[j];
+      for(j=first;j<m;j++) 
+	level[perm[j]] = -1;
+
+      if(iter > 0 && newlevels <= levels) break;
+      levels = newlevels;
+      root = k;
+    }
+
+    /* Cuthill-McKee numbering of the component with neighbours in order of degree */
+    head = tail;
+    perm[tail++] = root;
+    done[root] = TRUE;
+    while(head < tail) {
+      k = perm[head++];
+      nodeg = tail;
+      for(j=rows[k];j<rows[k+1];j++) {
+	l = cols[j];
+	if(done[l]) continue;
+	done[l] = TRUE;
+	perm[tail++] = l;
+      }
+      for(j=nodeg+1;j<tail;j++) {
+	l = perm[j];
+	for(m=j-1;m>=nodeg && degree[perm[m]] > degree[l];m--) 
+	  perm[m+1] = perm[m];
+	perm[m+1] = l;
+      }
+    }
+  }
+
+  /* Reverse the order */
+  for(i=0;i<n/2;i++) {
+    k = perm[i];
+    perm[i] = perm[n-1-i];
+    perm[n-1-i] = k;
+  }
+
+  free_Ivector(degree,0,n-1);
+  free_Ivector(level,0,n-1);
+  free_Ivector(done,0,n-1);
+}
+
+
+int ReorderElementsLocality(struct FemType *data,struct BoundaryType *bound,
+			    int method,int info)
+/* Renumbers the nodes for locality either by reverse Cuthill-McKee (method 1) 
+   or along a Hilbert curve (method 2). The elements are then ordered by their 
+   smallest new node index so that they follow the nodes. Works for all element types. */
+{
+  int i,j,k,noknots,noelements,nonodes,bits;
+  int *rows,*cols,*perm,*iperm,*elemperm,*ielemperm,*count,*minnode,*newint;
+  int **newtopology;
+  unsigned long long *key,*key2;
+  Real *newx,*newy,*newz,mincoord[3],maxcoord[3],scale;
+
+  noknots = data->noknots;
+  noelements = data->noelements;
+
+  if(info) printf("Reordering %d nodes and %d elements for locality using %s.\n",
+		  noknots,noelements,method == 1 ? "reverse Cuthill-McKee" : "a Hilbert curve");
+
+  i = CalculateIndexwidth(data,FALSE,NULL);
+  if(info) printf("Indexwidth of the original node order is %d.\n",i);
+
+  perm = Ivector(0,noknots-1);
+
+  if(method == 1) {
+    CreateNodalGraphCRS(data,FALSE,&rows,&cols);
+    OrderCuthillMckee(noknots,rows,cols,perm);
+    free(cols);
+    free_Ivector(rows,0,noknots);
+  }
+  else {
+    mincoord[0] = maxcoord[0] = data->x[1];
+    mincoord[1] = maxcoord[1] = data->y[1];
+    mincoord[2] = maxcoord[2] = (data->dim == 3) ? data->z[1] : 0.0;
+    for(i=1;i<=noknots;i++) {
+      mincoord[0] = MIN(mincoord[0],data->x[i]);
+      maxcoord[0] = MAX(maxcoord[0],data->x[i]);
+      mincoord[1] = MIN(mincoord[1],data->y[i]);
+      maxcoord[1] = MAX(maxcoord[1],data->y[i]);
+      if(data->dim == 3) {
+	mincoord[2] = MIN(mincoord[2],data->z[i]);
+	maxcoord[2] = MAX(maxcoord[2],data->z[i]);
+      }
+    }
+    scale = 0.0;
+    for(j=0;j<MAX(data->dim,1);j++) 
+      scale = MAX(scale,maxcoord[j]-mincoord[j]);
+    if(scale <= 0.0) scale = 1.0;
+    bits = (data->dim == 3) ? 21 : 31;
+    scale = ((1u << bits) - 1) / scale;
+
+    key = (unsigned long long*) malloc((size_t) noknots*sizeof(unsigned long long));
+    key2 = (unsigned long long*) malloc((size_t) noknots*sizeof(unsigned long long));
+    newint = Ivector(0,noknots-1);
+
+#pragma omp parallel for
+    for(i=0;i<noknots;i++) {
+      unsigned int X[3];
+      X[0] = (unsigned int) (scale * (data->x[i+1]-mincoord[0]));
+      X[1] = (unsigned int) (scale * (data->y[i+1]-mincoord[1]));
+      X[2] = (data->dim == 3) ? (unsigned int) (scale * (data->z[i+1]-mincoord[2])) : 0;
+      key[i] = SfcKey(X,MAX(data->dim,1),bits,data->dim > 1);
+      perm[i] = i;
+    }
+    SfcRadixSort(noknots,MAX(data->dim,1)*bits,key,perm,key2,newint);
+
+    free(key);
+    free(key2);
+    free_Ivector(newint,0,noknots-1);
+  }
+
+  /* Inverse node permutation, 1-based */
+  iperm = Ivector(1,noknots);
+  for(i=0;i<noknots;i++) 
+    iperm[perm[i]+1] = i+1;
+
+  /* Order the elements by their smallest new node index using a counting sort */
+  minnode = Ivector(1,noelements);
+  count = Ivector(0,noknots+1);
+  for(i=0;i<=noknots+1;i++) count[i] = 0;
+  for(j=1;j<=noelements;j++) {
+    nonodes = data->elementtypes[j]%100;
+    k = noknots;
+    for(i=0;i<nonodes;i++) 
+      k = MIN(k,iperm[data->topology[j][i]]);
+    minnode[j] = k;
+    count[k+1] += 1;
+  }
+  for(i=1;i<=noknots+1;i++) 
+    count[i] += count[i-1];
+  elemperm = Ivector(1,noelements);
+  ielemperm = Ivector(1,noelements);
+  for(j=1;j<=noelements;j++) {
+    k = count[minnode[j]]++;
+    elemperm[k+1] = j;
+    ielemperm[j] = k+1;
+  }
+  free_Ivector(count,0,noknots+1);
+  free_Ivector(minnode,1,noelements);
+
+  if(info) printf("Moving knots to new positions\n");
+  newx = Rvector(1,noknots);
+  newy = Rvector(1,noknots);
+  newz = NULL;
+  if(data->dim == 3) newz = Rvector(1,noknots);
+  for(i=1;i<=noknots;i++) {
+    newx[i] = data->x[perm[i-1]+1];
+    newy[i] = data->y[perm[i-1]+1];
+    if(data->dim == 3) newz[i] = data->z[perm[i-1]+1];
+  }
+  free_Rvector(data->x,1,noknots);
+  free_Rvector(data->y,1,noknots);
+  if(data->dim == 3) free_Rvector(data->z,1,noknots);
+  data->x = newx;
+  data->y = newy;
+  if(data->dim == 3) data->z = newz;
+
+  if(info) printf("Moving the elements to new positions\n");
+  newtopology = Imatrix(1,noelements,0,data->maxnodes-1);
+  newint = Ivector(1,noelements);
+  for(j=1;j<=noelements;j++) {
+    k = elemperm[j];
+    nonodes = data->elementtypes[k]%100;
+    for(i=0;i<nonodes;i++) 
+      newtopology[j][i] = iperm[data->topology[k][i]];
+  }
+  FreeTopology(data);
+  data->topology = newtopology;
+
+  for(j=1;j<=noelements;j++) 
+    newint[j] = data->material[elemperm[j]];
+  for(j=1;j<=noelements;j++) 
+    data->material[j] = newint[j];
+  for(j=1;j<=noelements;j++) 
+    newint[j] = data->elementtypes[elemperm[j]];
+  for(j=1;j<=noelements;j++) 
+    data->elementtypes[j] = newint[j];
+  free_Ivector(newint,1,noelements);
+
+  if(info) printf("Moving the parents of the boundary elements.\n");
+  for(j=0;j < MAXBOUNDARIES;j++) {
+    if(!bound[j].created) continue;
+    for(i=1; i <= bound[j].nosides; i++) {
+      bound[j].parent[i] = ielemperm[bound[j].parent[i]];
+      if(bound[j].parent2[i]) 
+	bound[j].parent2[i] = ielemperm[bound[j].parent2[i]];
+    }
+  }
+
+  i = CalculateIndexwidth(data,FALSE,NULL);
+  if(info) printf("Indexwidth of the new node order is %d.\n",i); 
+
+  free_Ivector(perm,0,noknots-1);
+  free_Ivector(iperm,1,noknots);
+  free_Ivector(elemperm,1,noelements);
+  free_Ivector(ielemperm,1,noelements);
+
+  return(0);
+}
+
+
 #if PARTMETIS 
 int ReorderElementsMetis(struct FemType *data,int info)
 /* Calls the fill reduction ordering algorithm of Metis library. */
@@ -5793,7 +6989,7 @@ int ReorderElementsMetis(struct FemType *data,int info)
       newtopology[j][i] = iperm[k-1]+1;
     }
   }
-  free_Imatrix(data->topology,1,noelements,0,data->maxnodes-1);
+  FreeTopology(data);
   data->topology = newtopology;
 
   i = CalculateIndexwidth(data,FALSE,perm);
@@ -6,7 +6,7 @@
 int LoadSolutionElmer(struct FemType *data,int results,char *prefix,int info);
 int LoadElmerInput(struct FemType *data,struct BoundaryType *bound,
 		   char *prefix,int info);
-int FuseSolutionElmerPartitioned(char *prefix,char *outfile,int decimals,int parts,
+int FuseSolutionElmerPartitioned(char *prefix,char *outfile,char *meshdir,int decimals,int parts,
 				 int minstep, int maxstep, int dstep, int info);
 int SaveSolutionElmer(struct FemType *data,struct BoundaryType *bound,
 		      int nobound,char *prefix,int decimals,int info);
@@ -31,6 +31,7 @@ int PartitionConnectedElements1D(struct FemType *data,struct BoundaryType *bound
 				 struct ElmergridType *eg, int info);
 int PartitionSimpleNodes(struct FemType *data,int dimpart[],int dimper[],
 			 int partorder, Real corder[],int info);
+int PartitionSpaceFillingCurve(struct FemType *data,int partitions,int sfcopt,int info);
 #if PARTMETIS
 int PartitionMetisMesh(struct FemType *data,struct ElmergridType *eg,
 		       int partitions,int dual,int info);
@@ -39,6 +40,9 @@ int PartitionMetisGraph(struct FemType *data,struct BoundaryType *bound,
 			int dual,int info);
 int ReorderElementsMetis(struct FemType *data,int info);
 #endif
+int ReorderElementsLocality(struct FemType *data,struct BoundaryType *bound,
+			    int method,int info);
+int BenchmarkNodalGraph(struct FemType *data,int info);
 int OptimizePartitioningAtBoundary(struct FemType *data,struct BoundaryType *bound,int info);
 int OptimizePartitioning(struct FemType *data,struct BoundaryType *bound,int noopt,
 			 int partbw,int info);
@@ -34,6 +34,15 @@
 #include <limits.h>
 /*#include <strings.h>*/
 /*#include <unistd.h>*/
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "nrutil.h"
 #include "common.h"
@@ -49,11 +58,11 @@ static int linenumber;
 
 static int Getrow(char *line1,FILE *io,int upper) 
 {
-  int i,isend;
+  int i,len,isend;
   char line0[MAXLINESIZE],*charend;
 
-  for(i=0;i<MAXLINESIZE;i++) 
-    line0[i] = ' ';
+  /* The part after the string is filled with spaces */
+  memset(line0,' ',MAXLINESIZE);
 
  newline:
   charend = fgets(line0,MAXLINESIZE,io);
@@ -64,15 +73,16 @@ static int Getrow(char *line1,FILE *io,int upper)
   if(isend) return(1);
 
   if(line0[0] == '#' || line0[0] == '!') goto newline;
-  if(strstr(line0,"#")) goto newline;
+  if(strchr(line0,'#')) goto newline;
 
+  len = strlen(line0);
   if(upper) {
-    for(i=0;i<MAXLINESIZE;i++) 
+    for(i=0;i<len;i++) 
       line1[i] = toupper(line0[i]);
+    memcpy(line1+len,line0+len,MAXLINESIZE-len);
   }
   else {
-    for(i=0;i<MAXLINESIZE;i++) 
-      line1[i] = line0[i];    
+    memcpy(line1,line0,MAXLINESIZE);
   }
 
   return(0);
@@ -80,11 +90,10 @@ static int Getrow(char *line1,FILE *io,int upper)
 
 static int GetrowDouble(char *line1,FILE *io)
 {
-  int i,isend;
+  int i,len,isend;
   char line0[MAXLINESIZE],*charend;
 
-  for(i=0;i<MAXLINESIZE;i++) 
-    line0[i] = ' ';
+  memset(line0,' ',MAXLINESIZE);
 
  newline:
   charend = fgets(line0,MAXLINESIZE,io);
@@ -95,17 +104,18 @@ static int GetrowDouble(char *line1,FILE *io)
   if(isend) return(1);
 
   if(line0[0] == '#' || line0[0] == '!') goto newline;
-  if(strstr(line0,"#")) goto newline;
-
-  for(i=0;i<MAXLINESIZE;i++) { 
+  if(strchr(line0,'#')) goto newline;
 
-    /* The fortran double is not recognized by C string operators */
+  /* The fortran double is not recognized by C string operators */
+  len = strlen(line0);
+  for(i=0;i<len;i++) { 
     if( line0[i] == 'd' || line0[i] == 'D' ) {
       line1[i] = 'e';
     } else {
       line1[i] = line0[i];    
     }
   }
+  memcpy(line1+len,line0+len,MAXLINESIZE-len);
 
   return(0);
 }
@@ -1219,7 +1229,7 @@ int LoadFidapInput(struct FemType *data,char *prefix,int info)
 	      for(i=0;i<data->elementtypes[j] % 100;i++)
 		topology[j][i] = data->topology[j][i];
 	  }
-	  free_Imatrix(data->topology,1,data->noelements,0,data->maxnodes-1);
+	  FreeTopology(data);
 	  data->maxnodes = maxnodes = nodes;
 	  data->topology = topology;
 	}
@@ -2952,6 +2962,123 @@ end:
 
 
 
+/* Chunks per thread in the parallel parsing of the ascii sections */
+#define PARSECHUNKS 8
+
+struct MeshFileType {
+  char *buf;
+  size_t size;
+  int mapped;
+};
+
+
+static int MapMeshFile(char *filename,struct MeshFileType *mf)
+/* Maps the whole file in memory. Where mmap is not available the file is read. 
+   In both cases mf->buf[mf->size] is readable and zero, so that strtol and strtod 
+   stop at the end of the buffer even on a truncated last line. */
+{
+  FILE *in;
+
+  mf->buf = NULL;
+  mf->size = 0;
+  mf->mapped = FALSE;
+
+#ifndef _WIN32
+  {
+    int fd;
+    struct stat st;
+
+    fd = open(filename,O_RDONLY);
+    if(fd < 0) return(1);
+    /* The tail of the last page is zero filled. When the file ends exactly at a 
+       page boundary there is no such tail and the file is read instead. */
+    if(fstat(fd,&st) == 0 && st.st_size > 0 && st.st_size % sysconf(_SC_PAGESIZE) != 0) {
+      mf->buf = (char*) mmap(NULL,(size_t) st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+      if(mf->buf == MAP_FAILED) {
+	mf->buf = NULL;
+      }
+      else {
+	mf->size = (size_t) st.st_size;
+	mf->mapped = TRUE;
+#ifdef MADV_SEQUENTIAL
+	madvise(mf->buf,mf->size,MADV_SEQUENTIAL);
+#endif
+      }
+    }
+    close(fd);
+    if(mf->mapped) return(0);
+  }
+#endif
+
+  if ((in = fopen(filename,"rb")) == NULL) return(1);
+  fseek(in,0,SEEK_END);
+  mf->size = (size_t) ftell(in);
+  rewind(in);
+  mf->buf = (char*) malloc(mf->size+1);
+  if(!mf->buf || fread(mf->buf,1,mf->size,in) != mf->size) {
+    free(mf->buf);
+    mf->buf = NULL;
+    fclose(in);
+    return(2);
+  }
+  mf->buf[mf->size] = '\0';
+  fclose(in);
+  return(0);
+}
+
+
+static void UnmapMeshFile(struct MeshFileType *mf)
+{
+  if(!mf->buf) return;
+#ifndef _WIN32
+  if(mf->mapped) 
+    munmap(mf->buf,mf->size);
+  else
+#endif
+    free(mf->buf);
+  mf->buf = NULL;
+}
+
+
+static char *NextLine(char *cp,char *end)
+/* Position after the next newline, or the end of the buffer */
+{
+  cp = (char*) memchr(cp,'\n',end-cp);
+  return(cp ? cp+1 : end);
+}
+
+
+static char *NextMarker(char *cp,char *end)
+/* Position of the next line starting with '$' */
+{
+  while(cp < end) {
+    cp = (char*) memchr(cp,'$',end-cp);
+    if(!cp) return(end);
+    if(cp[-1] == '\n') return(cp);
+    cp++;
+  }
+  return(end);
+}
+
+
+static int SplitSection(char *start,char *end,int nochunks,char **chunkstart)
+/* Splits the lines of a section into chunks of about the same size */
+{
+  int c;
+  char *cp;
+
+  if(end - start < (1<<16)) nochunks = 1;
+  chunkstart[0] = start;
+  for(c=1;c<nochunks;c++) {
+    cp = start + (size_t) (end-start) / nochunks * c;
+    cp = NextLine(cp-1,end);
+    chunkstart[c] = MAX(cp,chunkstart[c-1]);
+  }
+  chunkstart[nochunks] = end;
+  return(nochunks);
+}
+
+
 static int GmshToElmerType(int gmshtype)
 {
   int elmertype = 0;
@@ -3262,167 +3389,396 @@ allocate:
 
 static int LoadGmshInput2(struct FemType *data,struct BoundaryType *bound,
 			  char *filename,int info)
+/* Reads the Gmsh 2 format in ascii or binary. The file is mapped in memory and 
+   the node and element sections are parsed in parallel chunks. */
 {
-  int noknots = 0,noelements = 0,maxnodes,dim,notags;
-  int elemind[MAXNODESD2],elementtype;
-  int i,j,k,allocated,*revindx=NULL,maxindx;
-  int elemno, gmshtype, tagphys=0, taggeom=0, tagpart, elemnodes,maxelemtype;
-  int usetaggeom,tagmat,verno;
-  FILE *in;
-  char *cp,line[MAXLINESIZE];
-
-  if ((in = fopen(filename,"r")) == NULL) {
+  int noknots = 0,noelements = 0,maxnodes,dim;
+  int i,j,k,c,*revindx=NULL,maxindx,maxelemtype,usetaggeom,binary,datasize,one;
+  int nochunks,maxchunks,nothreads,nolines,errors,elementtype,elemnodes;
+  int noblocks,maxblocks,*blocktype,*blockelems,*blocktags;
+  int *chunklines,*chunkmax,*chunkflag,*elemfirst;
+  char **chunkstart,**blockstart;
+  char *cp,*end,*nodestart,*nodeend,*elemstart,*elemend;
+  Real verno;
+  struct MeshFileType mf;
+
+  if(MapMeshFile(filename,&mf)) {
     printf("LoadGmshInput2: The opening of the mesh file %s failed!\n",filename);
     return(1);
   }
   if(info) printf("Loading mesh in Gmsh format 2.0 from file %s\n",filename);
 
-  allocated = FALSE;
   dim = 3;
   maxnodes = 0;
   maxindx = 0;
   maxelemtype = 0;
   usetaggeom = FALSE;
+  binary = FALSE;
+  datasize = sizeof(double);
+  errors = 0;
+  noblocks = maxblocks = 0;
+  blocktype = blockelems = blocktags = NULL;
+  blockstart = NULL;
+  nodestart = nodeend = elemstart = elemend = NULL;
+
+  nothreads = 1;
+#ifdef _OPENMP
+  nothreads = omp_get_max_threads();
+#endif
+  maxchunks = PARSECHUNKS * nothreads;
+  chunkstart = (char**) malloc((maxchunks+1)*sizeof(char*));
+  chunklines = Ivector(0,maxchunks);
+  chunkmax = Ivector(0,maxchunks);
+  chunkflag = Ivector(0,maxchunks);
+  elemfirst = Ivector(0,maxchunks);
+
+  /* Locate the sections */
+  cp = mf.buf;
+  end = mf.buf + mf.size;
+
+  while(cp < end) {
+    if(*cp != '$') {
+      cp = NextLine(cp,end);
+      continue;
+    }
 
-omstart:
-
-  for(;;) {
-    if(Getrow(line,in,FALSE)) goto end;
-    if(strstr(line,"$End")) continue;
+    if(!strncmp(cp,"$MeshFormat",11)) {
+      cp = NextLine(cp,end);
+      verno = next_real(&cp);
+      binary = next_int(&cp);
+      datasize = next_int(&cp);
 
-    if(strstr(line,"$MeshFormat")) {
-      getline;
-      cp = line;
-      verno = next_int(&cp);
-
-      if(verno != 2) {
-	printf("Version number is not compatible with the parser: %d\n",verno);
+      if((int) verno != 2) {
+	printf("Version number is not compatible with the parser: %d\n",(int) verno);
       }
-
-      getline;
-      if(!strstr(line,"$EndMeshFormat")) {
-	printf("$MeshFormat section should end to string $EndMeshFormat:\n%s\n",line);
+      cp = NextLine(cp,end);
+      if(binary) {
+	if(info) printf("The Gmsh file is in binary format\n");
+	memcpy(&one,cp,sizeof(int));
+	if(one != 1) {
+	  printf("The binary Gmsh file has a different byte order!\n");
+	  errors++;
+	  goto end;
+	}
+	if(datasize != sizeof(double)) {
+	  printf("The binary Gmsh file has unsupported data size %d\n",datasize);
+	  errors++;
+	  goto end;
+	}
+	cp = NextLine(cp+sizeof(int),end);
+      }
+      if(strncmp(cp,"$EndMeshFormat",14)) {
+	printf("$MeshFormat section should end to string $EndMeshFormat\n");
       }      
     }
       
-    else if(strstr(line,"$Nodes")) {
-      getline;
-      cp = line;
+    else if(!strncmp(cp,"$Nodes",6)) {
+      cp = NextLine(cp,end);
       noknots = next_int(&cp);
-
-      for(i=1; i <= noknots; i++) {
-	getline;
-	cp = line;
-
-	j = next_int(&cp);
-	if(allocated) {
-	  if(maxindx > noknots) revindx[j] = i;
-	  data->x[i] = next_real(&cp);
-	  data->y[i] = next_real(&cp);
-	  if(dim > 2) data->z[i] = next_real(&cp);
-	}
-	else {
-	  maxindx = MAX(j,maxindx);
+      nodestart = NextLine(cp,end);
+      if(binary) {
+	if(noknots < 0 || (size_t) (end-nodestart) < 
+	   (size_t) noknots * (sizeof(int)+3*sizeof(double))) {
+	  printf("The binary $Nodes section is shorter than %d nodes\n",noknots);
+	  errors++;
+	  goto end;
 	}
+	nodeend = nodestart + (size_t) noknots * (sizeof(int)+3*sizeof(double));
       }
-      getline;
-      if(!strstr(line,"$EndNodes")) {
-	printf("$Nodes section should end to string $EndNodes:\n%s\n",line);
+      else
+	nodeend = NextMarker(nodestart,end);
+      cp = nodeend;
+      if(binary) cp = NextLine(cp,end);
+      if(strncmp(cp,"$EndNodes",9)) {
+	printf("$Nodes section should end to string $EndNodes\n");
+	errors++;
       }           
     }
     
-    else if(strstr(line,"$Elements")) {
-      getline;
-      cp = line;
+    else if(!strncmp(cp,"$Elements",9)) {
+      cp = NextLine(cp,end);
       noelements = next_int(&cp);
-
-      for(i=1; i <= noelements; i++) {
-	getline;
-	
-	cp = line;
-	elemno = next_int(&cp);
-	gmshtype = next_int(&cp);
-	elementtype = GmshToElmerType(gmshtype);
-
-	if(allocated) {
-	  elemnodes = elementtype % 100;
-	  data->elementtypes[i] = elementtype;
-
-	  /* Point does not seem to have physical properties */
-	  notags = next_int(&cp);
-	  if(notags > 0) tagphys = next_int(&cp);
-	  if(notags > 1) taggeom = next_int(&cp);
-	  if(notags > 2) tagpart = next_int(&cp);
-	  for(j=4;j<=notags;j++)
-	    next_int(&cp);
-
-	  if(tagphys) {
-	    tagmat = tagphys;
+      elemstart = NextLine(cp,end);
+
+      if(binary) {
+	/* The elements are in blocks with a header of type, count and number of tags */
+	int header[3];
+	cp = elemstart;
+	for(i=0;i<noelements;) {
+	  if((size_t) (end-cp) < 3*sizeof(int)) break;
+	  memcpy(header,cp,3*sizeof(int));
+	  cp += 3*sizeof(int);
+	  elementtype = GmshToElmerType(header[0]);
+	  if(!elementtype || header[1] <= 0 || header[1] > noelements-i || header[2] < 0 ||
+	     (size_t) (end-cp) < (size_t) header[1] * (1 + header[2] + elementtype%100) * sizeof(int)) {
+	    printf("The binary $Elements section has an invalid block at element %d\n",i+1);
+	    errors++;
+	    goto end;
 	  }
-	  else {
-	    tagmat = taggeom;
-	    usetaggeom = TRUE;
+	  if(noblocks == maxblocks) {
+	    maxblocks = 2*maxblocks + 16;
+	    blocktype = (int*) realloc(blocktype,maxblocks*sizeof(int));
+	    blockelems = (int*) realloc(blockelems,maxblocks*sizeof(int));
+	    blocktags = (int*) realloc(blocktags,maxblocks*sizeof(int));
+	    blockstart = (char**) realloc(blockstart,maxblocks*sizeof(char*));
 	  }
-
-	  data->material[i] = tagmat;
-	  for(j=0;j<elemnodes;j++)
-	    elemind[j] = next_int(&cp);
-
-	  GmshToElmerIndx(elementtype,elemind);	  
-
-	  for(j=0;j<elemnodes;j++)
-	    data->topology[i][j] = elemind[j];
-	}
-	else {
+	  blocktype[noblocks] = elementtype;
+	  blockelems[noblocks] = header[1];
+	  blocktags[noblocks] = header[2];
+	  blockstart[noblocks] = cp;
+	  noblocks++;
 	  maxelemtype = MAX(maxelemtype,elementtype);
+	  cp += (size_t) header[1] * (1 + header[2] + elementtype%100) * sizeof(int);
+	  i += header[1];
 	}
-	
+	if(i != noelements) {
+	  printf("The binary $Elements section is shorter than %d elements\n",noelements);
+	  errors++;
+	  goto end;
+	}
+	elemend = cp;
+	cp = NextLine(cp,end);
       }
-      getline;
-      if(!strstr(line,"$EndElements")) {
-	printf("$Elements section should end to string $EndElements:\n%s\n",line);
+      else {
+	elemend = NextMarker(elemstart,end);
+	cp = elemend;
+      }
+      if(strncmp(cp,"$EndElements",12)) {
+	printf("$Elements section should end to string $EndElements\n");
+	errors++;
       }   
     }
-    else if(strstr(line,"$PhysicalNames")) {
+    else if(!strncmp(cp,"$PhysicalNames",14)) {
       if(info) printf("Physical names are not accounted for\n");
-      getline;
-      cp = line;
-      i = next_int(&cp);
-      for(;i>0;i--) getline;
-
-      getline;
-      if(!strstr(line,"$EndPhysicalNames")) {
-	printf("$PhysicalNames section should end to string $EndPhysicalNames:\n%s\n",line);
+      cp = NextMarker(NextLine(cp,end),end);
+      if(strncmp(cp,"$EndPhysicalNames",17)) {
+	printf("$PhysicalNames section should end to string $EndPhysicalNames\n");
       }   
     }
-    else {
-      if(!allocated) printf("Untreated command: %s",line);
+    else if(strncmp(cp,"$End",4)) {
+      printf("Untreated command: %.*s",(int) (NextLine(cp,end)-cp),cp);
+      for(;;) {
+	cp = NextMarker(NextLine(cp,end),end);
+	if(cp >= end || !strncmp(cp,"$End",4)) break;
+      }
     }
+    cp = NextLine(cp,end);
+  }
 
+  if(errors || !nodestart || !elemstart) {
+    printf("LoadGmshInput2: Could not find the nodes and elements in %s\n",filename);
+    errors++;
+    goto end;
   }
 
- end:
+  /* Count the lines and find the largest indexes in chunks */
+  if(!binary) {
+    nochunks = SplitSection(elemstart,elemend,maxchunks,chunkstart);
+#pragma omp parallel for private(cp,elementtype) schedule(dynamic,1)
+    for(c=0;c<nochunks;c++) {
+      elemfirst[c] = chunkmax[c] = 0;
+      for(cp=chunkstart[c];cp<chunkstart[c+1];cp=NextLine(cp,end)) {
+	char *lp = cp;
+	next_int(&lp);
+	elementtype = GmshToElmerType(next_int(&lp));
+	chunkmax[c] = MAX(chunkmax[c],elementtype);
+	elemfirst[c] += 1;
+      }
+    }
+    nolines = 0;
+    for(c=0;c<nochunks;c++) {
+      k = elemfirst[c];
+      elemfirst[c] = nolines;
+      nolines += k;
+      maxelemtype = MAX(maxelemtype,chunkmax[c]);
+    }
+    if(nolines != noelements) {
+      printf("LoadGmshInput2: There are %d element lines instead of %d\n",nolines,noelements);
+      errors++;
+      goto end;
+    }
+  }
 
+  if(binary) {
+    nochunks = (noknots < (1<<16)) ? 1 : maxchunks;
+#pragma omp parallel for private(i,cp) schedule(dynamic,1)
+    for(c=0;c<nochunks;c++) {
+      int ind;
+      chunkmax[c] = 0;
+      for(i=(int)((long long) noknots*c/nochunks);i<(int)((long long) noknots*(c+1)/nochunks);i++) {
+	cp = nodestart + (size_t) i * (sizeof(int)+3*sizeof(double));
+	memcpy(&ind,cp,sizeof(int));
+	chunkmax[c] = MAX(chunkmax[c],ind);
+      }
+    }
+    for(c=0;c<nochunks;c++) 
+      maxindx = MAX(maxindx,chunkmax[c]);
+  }
+  else {
+    nochunks = SplitSection(nodestart,nodeend,maxchunks,chunkstart);
+#pragma omp parallel for private(cp,j) schedule(dynamic,1)
+    for(c=0;c<nochunks;c++) {
+      chunklines[c] = chunkmax[c] = 0;
+      for(cp=chunkstart[c];cp<chunkstart[c+1];cp=NextLine(cp,end)) {
+	char *lp = cp;
+	j = next_int(&lp);
+	chunkmax[c] = MAX(chunkmax[c],j);
+	chunklines[c] += 1;
+      }
+    }
+    nolines = 0;
+    for(c=0;c<nochunks;c++) {
+      nolines += chunklines[c];
+      maxindx = MAX(maxindx,chunkmax[c]);
+    }
+    if(nolines != noknots) {
+      printf("LoadGmshInput2: There are %d node lines instead of %d\n",nolines,noknots);
+      errors++;
+      goto end;
+    }
+  }
 
-  if(!allocated) {
-    maxnodes = maxelemtype % 100;
-    InitializeKnots(data);
-    data->dim = dim;
-    data->maxnodes = maxnodes;
-    data->noelements = noelements;
-    data->noknots = noknots;
+  maxnodes = maxelemtype % 100;
+  InitializeKnots(data);
+  data->dim = dim;
+  data->maxnodes = maxnodes;
+  data->noelements = noelements;
+  data->noknots = noknots;
 
-    if(info) printf("Allocating for %d knots and %d elements.\n",noknots,noelements);
-    AllocateKnots(data);
+  if(info) printf("Allocating for %d knots and %d elements.\n",noknots,noelements);
+  AllocateKnots(data);
 
-    if(maxindx > noknots) {
-      revindx = Ivector(1,maxindx);
-      for(i=1;i<=maxindx;i++) revindx[i] = 0;
+  if(maxindx > noknots) {
+    revindx = Ivector(1,maxindx);
+    for(i=1;i<=maxindx;i++) revindx[i] = 0;
+  }
+
+  /* Read the nodes */
+  if(binary) {
+#pragma omp parallel for private(cp)
+    for(i=1;i<=noknots;i++) {
+      int ind;
+      double coord[3];
+      cp = nodestart + (size_t) (i-1) * (sizeof(int)+3*sizeof(double));
+      memcpy(&ind,cp,sizeof(int));
+      memcpy(coord,cp+sizeof(int),3*sizeof(double));
+      if(maxindx > noknots && ind > 0) revindx[ind] = i;
+      data->x[i] = coord[0];
+      data->y[i] = coord[1];
+      data->z[i] = coord[2];
     }
-    rewind(in);
-    allocated = TRUE;
-    goto omstart;
   }
+  else {
+    nolines = 0;
+    for(c=0;c<nochunks;c++) {
+      k = chunklines[c];
+      chunklines[c] = nolines;
+      nolines += k;
+    }
+#pragma omp parallel for private(cp,i,j) schedule(dynamic,1)
+    for(c=0;c<nochunks;c++) {
+      i = chunklines[c];
+      for(cp=chunkstart[c];cp<chunkstart[c+1];cp=NextLine(cp,end)) {
+	char *lp = cp;
+	i++;
+	j = next_int(&lp);
+	if(maxindx > noknots && j > 0) revindx[j] = i;
+	data->x[i] = next_real(&lp);
+	data->y[i] = next_real(&lp);
+	if(dim > 2) data->z[i] = next_real(&lp);
+      }
+    }
+  }
+
+  /* Read the elements */
+  if(binary) {
+    k = 0;
+    for(c=0;c<noblocks;c++) {
+      int notags,recsize,missing;
+      elementtype = blocktype[c];
+      elemnodes = elementtype % 100;
+      notags = blocktags[c];
+      recsize = 1 + notags + elemnodes;
+      missing = FALSE;
+
+#pragma omp parallel for private(j,cp) reduction(||:missing)
+      for(i=1;i<=blockelems[c];i++) {
+	int tags[2],elemind[MAXNODESD2];
+	cp = blockstart[c] + (size_t) (i-1) * recsize * sizeof(int) + sizeof(int);
+	tags[0] = tags[1] = 0;
+	memcpy(tags,cp,MIN(notags,2)*sizeof(int));
+	memcpy(elemind,cp+notags*sizeof(int),elemnodes*sizeof(int));
+	GmshToElmerIndx(elementtype,elemind);	  
+
+	data->elementtypes[k+i] = elementtype;
+	if(!tags[0]) missing = TRUE;
+	data->material[k+i] = tags[0] ? tags[0] : tags[1];
+	for(j=0;j<elemnodes;j++)
+	  data->topology[k+i][j] = elemind[j];
+      }
+
+      if(missing) usetaggeom = TRUE;
+      k += blockelems[c];
+    }
+  }
+  else {
+    nochunks = SplitSection(elemstart,elemend,maxchunks,chunkstart);
+#pragma omp parallel for private(cp,i,j) schedule(dynamic,1)
+    for(c=0;c<nochunks;c++) {
+      int elemind[MAXNODESD2],elementtype,elemnodes,notags,tagphys,taggeom;
+      i = elemfirst[c];
+      chunkflag[c] = FALSE;
+      for(cp=chunkstart[c];cp<chunkstart[c+1];cp=NextLine(cp,end)) {
+	char *lp = cp;
+	i++;
+	next_int(&lp);
+	elementtype = GmshToElmerType(next_int(&lp));
+	elemnodes = elementtype % 100;
+	data->elementtypes[i] = elementtype;
+
+	/* Point does not seem to have physical properties */
+	tagphys = taggeom = 0;
+	notags = next_int(&lp);
+	if(notags > 0) tagphys = next_int(&lp);
+	if(notags > 1) taggeom = next_int(&lp);
+	for(j=3;j<=notags;j++)
+	  next_int(&lp);
+
+	if(tagphys) {
+	  data->material[i] = tagphys;
+	}
+	else {
+	  data->material[i] = taggeom;
+	  chunkflag[c] = TRUE;
+	}
+
+	for(j=0;j<elemnodes;j++)
+	  elemind[j] = next_int(&lp);
+
+	GmshToElmerIndx(elementtype,elemind);	  
+
+	for(j=0;j<elemnodes;j++)
+	  data->topology[i][j] = elemind[j];
+      }
+    }
+    for(c=0;c<nochunks;c++) 
+      if(chunkflag[c]) usetaggeom = TRUE;
+  }
+
+ end:
+  UnmapMeshFile(&mf);
+  free(chunkstart);
+  free_Ivector(chunklines,0,maxchunks);
+  free_Ivector(chunkmax,0,maxchunks);
+  free_Ivector(chunkflag,0,maxchunks);
+  free_Ivector(elemfirst,0,maxchunks);
+  if(noblocks) {
+    free(blocktype);
+    free(blockelems);
+    free(blocktags);
+    free(blockstart);
+  }
+  if(errors) return(2);
 
   if(maxindx > noknots) {
     printf("Renumbering the Gmsh nodes from %d to %d\n",maxindx,noknots);
@@ -274,6 +274,7 @@ void InitParameters(struct ElmergridType *eg)
   eg->elements3d = 0;
   eg->nodes3d = 0;
   eg->metis = 0;
+  eg->partsfc = 0;
   eg->partopt = 0;
   eg->partoptim = FALSE;
   eg->partbcoptim = TRUE;
@@ -291,6 +292,7 @@ void InitParameters(struct ElmergridType *eg)
   eg->center = FALSE;
   eg->scale = FALSE;
   eg->order = FALSE;
+  eg->orderbench = FALSE;
   eg->boundbounds = 0;
   eg->saveinterval[0] = eg->saveinterval[1] = eg->saveinterval[2] = 0;
   eg->bulkbounds = 0;
@@ -311,6 +313,7 @@ void InitParameters(struct ElmergridType *eg)
   eg->periodicdim[0] = 0;
   eg->periodicdim[1] = 0;
   eg->periodicdim[2] = 0;
+  eg->periodicmap = FALSE;
   eg->bulkorder = FALSE;
   eg->boundorder = FALSE;
   eg->sidemappings = 0;
@@ -469,6 +472,15 @@ int InlineParameters(struct ElmergridType *eg,int argc,char *argv[])
     if(strcmp(argv[arg],"-metisorder") == 0) {
       eg->order = 3;
     }
+    if(strcmp(argv[arg],"-rcmorder") == 0) {
+      eg->order = 4;
+    }
+    if(strcmp(argv[arg],"-sfcorder") == 0) {
+      eg->order = 5;
+    }
+    if(strcmp(argv[arg],"-orderbench") == 0) {
+      eg->orderbench = TRUE;
+    }
     if(strcmp(argv[arg],"-centralize") == 0) {
       eg->center = TRUE;
     }
@@ -713,6 +725,20 @@ int InlineParameters(struct ElmergridType *eg,int argc,char *argv[])
 #endif     
     }
 
+    if(strcmp(argv[arg],"-partsfc") == 0) {
+      if(arg+1 >= argc) {
+	printf("The number of partitions is required as a parameter\n");
+	return(15);
+      }
+      else {
+	eg->partsfc = atoi(argv[arg+1]);
+	printf("The mesh will be partitioned along a space-filling curve to %d partitions.\n",eg->partsfc);
+	eg->partopt = 0;
+	if(arg+2 < argc) 
+	  if(argv[arg+2][0] != '-') eg->partopt = atoi(argv[arg+2]);
+      }
+    }
+
     if(strcmp(argv[arg],"-partjoin") == 0) {
       if(arg+1 >= argc) {
 	printf("The number of partitions is required as a parameter\n");
@@ -769,6 +795,18 @@ int InlineParameters(struct ElmergridType *eg,int argc,char *argv[])
       }
     }
 
+    if(strcmp(argv[arg],"-periodicmap") == 0) {
+      if(arg+6 >= argc) {
+	printf("Give the rotation angles and translation of the periodic mapping\n");
+ 	return(16);
+      }
+      else {
+	eg->periodicmap = TRUE;
+	for(i=0;i<6;i++) 
+	  eg->cperiodicmap[i] = atof(argv[arg+1+i]);
+      }
+    }
+
     if(strcmp(argv[arg],"-discont") == 0) {
       if(arg+1 >= argc) {
 	printf("Give the discontinuous boundary conditions.\n");
@@ -1184,6 +1222,9 @@ int LoadCommands(char *prefix,struct ElmergridType *eg,
       printf("This version of ElmerGrid was compiled without Metis library!\n");
 #endif
     }
+    else if(strstr(command,"PARTITION SFC")) {
+      sscanf(params,"%d%d",&eg->partsfc,&eg->partopt);
+    }
     else if(strstr(command,"PARTITION DUAL")) {
       for(j=0;j<MAXLINESIZE;j++) params[j] = toupper(params[j]);
       if(strstr(params,"TRUE")) eg->partdual = TRUE;      
@@ -1206,6 +1247,11 @@ int LoadCommands(char *prefix,struct ElmergridType *eg,
 	eg->partitions *= eg->partdim[i];
       }
     }
+    else if(strstr(command,"PERIODIC MAP")) {
+      sscanf(params,"%le%le%le%le%le%le",&eg->cperiodicmap[0],&eg->cperiodicmap[1],
+	     &eg->cperiodicmap[2],&eg->cperiodicmap[3],&eg->cperiodicmap[4],&eg->cperiodicmap[5]);
+      eg->periodicmap = TRUE;
+    }
     else if(strstr(command,"PERIODIC")) {
       if(eg->dim == 2) sscanf(params,"%d%d",&eg->periodicdim[0],&eg->periodicdim[1]);
       if(eg->dim == 3) sscanf(params,"%d%d%d",&eg->periodicdim[0],
@@ -35,6 +35,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <limits.h>
 
 #include "common.h"
@@ -896,6 +899,7 @@ void InitializeKnots(struct FemType *data)
   data->invtopo.created = FALSE;
   data->nodalgraph2.created = FALSE;
   data->dualgraph.created = FALSE;
+  data->elemtopo.created = FALSE;
 
   
   for(i=0;i<MAXDOFS;i++) {
@@ -920,7 +924,9 @@ void AllocateKnots(struct FemType *data)
 {
   int i;
 
-  data->topology = Imatrix(1,data->noelements,0,data->maxnodes-1);
+  /* The topology may have been allocated already in the compact form */
+  if(!data->elemtopo.created)
+    data->topology = Imatrix(1,data->noelements,0,data->maxnodes-1);
   data->material = Ivector(1,data->noelements);
   data->elementtypes = Ivector(1,data->noelements);
 
@@ -945,6 +951,126 @@ void AllocateKnots(struct FemType *data)
 }
 
 
+void AllocateTopology(struct FemType *data,int totnodes)
+/* Allocates the element topology in compact form where the nodes of 
+   the elements follow each other in elemtopo.cols. The rows of the 
+   topology are pointers to this block and they must be set by the caller 
+   before the element is used. Element i starts at elemtopo.rows[i-1] 
+   once the block has been packed by CompactTopology. */
+{
+  int i,noelements;
+  struct CRSType *elemtopo;
+
+  noelements = data->noelements;
+  elemtopo = &data->elemtopo;
+
+  elemtopo->rows = Ivector(0,noelements);
+  elemtopo->cols = Ivector(0,MAX(totnodes,1)-1);
+  elemtopo->rowsize = noelements;
+  elemtopo->colsize = totnodes;
+  elemtopo->created = TRUE;
+
+  for(i=0;i<=noelements;i++)
+    elemtopo->rows[i] = 0;
+
+  /* Same layout of row pointers as in Imatrix */
+  data->topology = (int**) malloc((size_t) (noelements+1)*sizeof(int*));
+  if(!data->topology) bigerror("AllocateTopology: allocation of the rows failed");
+  for(i=0;i<=noelements;i++)
+    data->topology[i] = elemtopo->cols;
+}
+
+
+static void DestroyTopology(int **topology,struct CRSType *elemtopo,int noelements,int maxnodes)
+{
+  if(elemtopo->created) {
+    free_Ivector(elemtopo->cols,0,MAX(elemtopo->colsize,1)-1);
+    free_Ivector(elemtopo->rows,0,elemtopo->rowsize);
+    free(topology);
+    elemtopo->created = FALSE;
+  }
+  else {
+    free_Imatrix(topology,1,noelements,0,maxnodes-1);
+  }
+}
+
+
+void FreeTopology(struct FemType *data)
+/* Frees the element topology in either the rectangular or the compact form. */
+{
+  DestroyTopology(data->topology,&data->elemtopo,data->noelements,data->maxnodes);
+  data->topology = NULL;
+}
+
+
+int CompactTopology(struct FemType *data,int info)
+/* Packs the element topology so that each element takes only as many 
+   entries as it has nodes. The rows of data->topology point to the packed 
+   block and may be used as before. For meshes with elements of different 
+   size this saves the unused tail of the rectangular topology matrix. */
+{
+  int i,j,nonodes,noelements,totnodes,packed;
+  long long oldsize;
+  int **topology,*cols;
+  struct CRSType elemtopo;
+
+  if(!data->created) return(1);
+
+  noelements = data->noelements;
+  totnodes = 0;
+  for(i=1;i<=noelements;i++) 
+    totnodes += data->elementtypes[i] % 100;
+
+  if(data->elemtopo.created) {
+    /* If the elements are already in order just update the offsets */
+    cols = data->elemtopo.cols;
+    packed = (totnodes <= data->elemtopo.colsize);
+    j = 0;
+    for(i=1;i<=noelements && packed;i++) {
+      if(data->topology[i] != cols + j) packed = FALSE;
+      j += data->elementtypes[i] % 100;
+    }
+    if(packed) {
+      j = 0;
+      data->elemtopo.rows[0] = 0;
+      for(i=1;i<=noelements;i++) {
+	j += data->elementtypes[i] % 100;
+	data->elemtopo.rows[i] = j;
+      }
+      return(0);
+    }
+    oldsize = data->elemtopo.colsize;
+  }
+  else {
+    oldsize = (long long)noelements * data->maxnodes;
+    /* Nothing to gain if all the elements have the maximum number of nodes */
+    if(totnodes >= oldsize) return(0);
+  }
+
+  topology = data->topology;
+  elemtopo = data->elemtopo;
+
+  AllocateTopology(data,totnodes);
+  cols = data->elemtopo.cols;
+
+  j = 0;
+  for(i=1;i<=noelements;i++) {
+    nonodes = data->elementtypes[i] % 100;
+    data->elemtopo.rows[i-1] = j;
+    data->topology[i] = cols + j;
+    memcpy(cols+j,topology[i],nonodes*sizeof(int));
+    j += nonodes;
+  }
+  data->elemtopo.rows[noelements] = j;
+
+  DestroyTopology(topology,&elemtopo,noelements,data->maxnodes);
+
+  if(info) printf("Compacted the element topology from %lld to %d entries\n",oldsize,totnodes);
+
+  return(0);
+}
+
+
 static void MovePointCircle(Real *lim,int points,Real *coords,
 			    Real x,Real y,Real *dx,Real *dy)
 {
@@ -1565,7 +1691,7 @@ void DestroyKnots(struct FemType *data)
       data->edofs[i] = 0;
     }
 
-  free_Imatrix(data->topology,1,data->noelements,0,data->maxnodes-1);
+  FreeTopology(data);
   free_Ivector(data->material,1,data->noelements);
   free_Ivector(data->elementtypes,1,data->noelements);
 
@@ -3187,7 +3313,7 @@ int ElementsToTriangles(struct FemType *data,struct BoundaryType *bound,
   }
 
 
-  free_Imatrix(data->topology,1,noelements,0,data->maxnodes-1);
+  FreeTopology(data);
   free_Ivector(data->material,1,noelements);
   free_Ivector(data->elementtypes,1,noelements);
   free_Ivector(needed,1,noknots);
@@ -3324,13 +3450,13 @@ int UniteMeshes(struct FemType *data1,struct FemType *data2,
       newtopo[i+data1->noelements][j] = data2->topology[i][j] + data1->noknots;
   }
 
-  free_Imatrix(data1->topology,1,data1->noelements,0,data1->maxnodes-1);
+  FreeTopology(data1);
   free_Ivector(data1->material,1,data1->noelements);
   free_Rvector(data1->x,1,data1->noknots);
   free_Rvector(data1->y,1,data1->noknots);
   if(data1->dim == 3) free_Rvector(data1->z,1,data1->noknots);
 
-  free_Imatrix(data2->topology,1,data2->noelements,0,data2->maxnodes-1);
+  FreeTopology(data2);
   free_Ivector(data2->material,1,data2->noelements);
   free_Rvector(data2->x,1,data2->noknots);
   free_Rvector(data2->y,1,data2->noknots);
@@ -3526,7 +3652,7 @@ int CloneMeshes(struct FemType *data,struct BoundaryType *bound,
       bound[bndr].discont = vdiscont;
   }
 
-  free_Imatrix(data->topology,1,data->noelements,0,data->maxnodes-1);
+  FreeTopology(data);
   free_Ivector(data->material,1,data->noelements);
   free_Rvector(data->x,1,data->noknots);
   free_Rvector(data->y,1,data->noknots);
@@ -3730,7 +3856,7 @@ int MirrorMeshes(struct FemType *data,struct BoundaryType *bound,
       bound[bndr].discont = vdiscont;
   }
 
-  free_Imatrix(data->topology,1,data->noelements,0,data->maxnodes-1);
+  FreeTopology(data);
   free_Ivector(data->material,1,data->noelements);
   free_Rvector(data->x,1,data->noknots);
   free_Rvector(data->y,1,data->noknots);
@@ -4098,6 +4224,7 @@ void ReorderElements(struct FemType *data,struct BoundaryType *bound,
 
   data->material = newmaterial;
   data->elementtypes = newelementtypes;
+  FreeTopology(data);
   data->topology = newtopology;
 
 
@@ -5325,7 +5452,7 @@ int IncreaseElementOrder(struct FemType *data,int info)
   free_Rvector(data->x,1,data->noknots);
   free_Rvector(data->y,1,data->noknots);
   free_Rvector(data->z,1,data->noknots);
-  free_Imatrix(data->topology,1,data->noelements,0,data->maxnodes);
+  FreeTopology(data);
   free_Imatrix(newnodetable,0,maxcon-1,1,noknots);
 
   data->x = newx;
@@ -5516,7 +5643,7 @@ int IncreaseElementOrderOld(struct FemType *data,int info)
   free_Rvector(data->x,1,data->noknots);
   free_Rvector(data->y,1,data->noknots);
   free_Rvector(data->z,1,data->noknots);
-  free_Imatrix(data->topology,1,data->noelements,0,data->maxnodes);
+  FreeTopology(data);
   
 
   data->x = newx;
@@ -6915,30 +7042,236 @@ void ReduceElementOrder(struct FemType *data,int matmin,int matmax)
 
 
 
+struct CellNodeType {
+  long long cell;
+  int node;
+};
+
+struct NodeGridType {
+  Real lim[3],h[3];
+  int n[3],nocells;
+  long long *cell;
+  int *start,*nodes;
+};
+
+static int CompareCellNodes(const void *a,const void *b)
+{
+  const struct CellNodeType *c1 = (const struct CellNodeType *) a;
+  const struct CellNodeType *c2 = (const struct CellNodeType *) b;
+
+  if(c1->cell < c2->cell) return(-1);
+  if(c1->cell > c2->cell) return(1);
+  return(c1->node - c2->node);
+}
+
+
+static void CreateNodeGrid(struct NodeGridType *grid,struct FemType *data,Real eps)
+/* Sorts the nodes by the cells of a uniform grid with cells at least eps wide. */
+{
+  int i,k,noknots,ind;
+  Real maxlim[3],coord;
+  struct CellNodeType *cellnodes;
+
+  noknots = data->noknots;
+
+  grid->lim[0] = maxlim[0] = data->x[1];
+  grid->lim[1] = maxlim[1] = data->y[1];
+  grid->lim[2] = maxlim[2] = (data->dim == 3) ? data->z[1] : 0.0;
+  for(i=2;i<=noknots;i++) {
+    for(k=0;k<3;k++) {
+      if(k==0) coord = data->x[i];
+      else if(k==1) coord = data->y[i];
+      else coord = (data->dim == 3) ? data->z[i] : 0.0;
+      if(coord < grid->lim[k]) grid->lim[k] = coord;
+      if(coord > maxlim[k]) maxlim[k] = coord;
+    }
+  }
+
+  /* Cell size is increased if needed to keep the cell index in 64 bits */
+  for(k=0;k<3;k++) {
+    grid->h[k] = eps;
+    if((maxlim[k]-grid->lim[k]) / eps > 1.0e6) grid->h[k] = (maxlim[k]-grid->lim[k]) / 1.0e6;
+    grid->n[k] = (int) ((maxlim[k]-grid->lim[k]) / grid->h[k]) + 1;
+  }
+
+  cellnodes = (struct CellNodeType*) malloc((size_t) noknots*sizeof(struct CellNodeType));
+
+#pragma omp parallel for private(k,coord,ind)
+  for(i=1;i<=noknots;i++) {
+    cellnodes[i-1].cell = 0;
+    for(k=0;k<3;k++) {
+      if(k==0) coord = data->x[i];
+      else if(k==1) coord = data->y[i];
+      else coord = (data->dim == 3) ? data->z[i] : 0.0;
+      ind = (int) ((coord-grid->lim[k])/grid->h[k]);
+      if(ind >= grid->n[k]) ind = grid->n[k]-1;
+      cellnodes[i-1].cell = cellnodes[i-1].cell * grid->n[k] + ind;
+    }
+    cellnodes[i-1].node = i;
+  }
+  qsort(cellnodes,noknots,sizeof(struct CellNodeType),CompareCellNodes);
+
+  grid->nodes = Ivector(0,noknots-1);
+  grid->nocells = 0;
+  for(i=0;i<noknots;i++) {
+    grid->nodes[i] = cellnodes[i].node;
+    if(i == 0 || cellnodes[i].cell != cellnodes[i-1].cell) grid->nocells++;
+  }
+
+  grid->cell = (long long*) malloc((size_t) grid->nocells*sizeof(long long));
+  grid->start = Ivector(0,grid->nocells);
+  grid->nocells = 0;
+  for(i=0;i<noknots;i++) {
+    if(i == 0 || cellnodes[i].cell != cellnodes[i-1].cell) {
+      grid->cell[grid->nocells] = cellnodes[i].cell;
+      grid->start[grid->nocells] = i;
+      grid->nocells++;
+    }
+  }
+  grid->start[grid->nocells] = noknots;
+  free(cellnodes);
+}
+
+
+static void DestroyNodeGrid(struct NodeGridType *grid,int noknots)
+{
+  free_Ivector(grid->nodes,0,noknots-1);
+  free_Ivector(grid->start,0,grid->nocells);
+  free(grid->cell);
+}
+
+
+static void CloseNodesOfCells(struct NodeGridType *grid,struct FemType *data,Real eps,
+			      int c0,int c1,int *ptr,int *list)
+/* Finds for the nodes in the cells c0...c1-1 the nodes with larger index closer 
+   than eps. Without list only their number is set to ptr[node+1], otherwise 
+   they are written to list starting from ptr[node]. The cells are visited 
+   in sorted order so that the neighbouring cells along the last direction 
+   form a range that only moves forward for each of the 3x3 neighbour rows. */
+{
+  int c,d,i,j,k,l,m,node,node2,no,ind[3],cursor[9];
+  long long cell,cmin,cmax;
+  Real dx,dy,dz;
+
+  for(d=0;d<9;d++) cursor[d] = -1;
+
+  for(c=c0;c<c1;c++) {
+    cell = grid->cell[c];
+    ind[2] = cell % grid->n[2];
+    ind[1] = (cell / grid->n[2]) % grid->n[1];
+    ind[0] = cell / grid->n[2] / grid->n[1];
+
+    for(l=grid->start[c];l<grid->start[c+1];l++) {
+      node = grid->nodes[l];
+      if(list) no = ptr[node]; else no = 0;
+
+      for(d=0;d<9;d++) {
+	i = ind[0] + d/3 - 1;
+	j = ind[1] + d%3 - 1;
+	if(i < 0 || i >= grid->n[0] || j < 0 || j >= grid->n[1]) continue;
+
+	cmin = ((long long) i*grid->n[1] + j)*grid->n[2] + MAX(ind[2]-1,0);
+	cmax = ((long long) i*grid->n[1] + j)*grid->n[2] + MIN(ind[2]+1,grid->n[2]-1);
+
+	if(cursor[d] < 0) {
+	  int lo = 0, hi = grid->nocells, mid;
+	  while(lo < hi) {
+	    mid = (lo+hi)/2;
+	    if(grid->cell[mid] < cmin) lo = mid+1;
+	    else hi = mid;
+	  }
+	  cursor[d] = lo;
+	}
+	while(cursor[d] < grid->nocells && grid->cell[cursor[d]] < cmin) cursor[d]++;
+
+	for(k=cursor[d];k<grid->nocells && grid->cell[k] <= cmax;k++) {
+	  for(m=grid->start[k];m<grid->start[k+1];m++) {
+	    node2 = grid->nodes[m];
+	    if(node2 <= node) continue;
+	    dx = data->x[node] - data->x[node2];
+	    dy = data->y[node] - data->y[node2];
+	    dz = (data->dim == 3) ? data->z[node] - data->z[node2] : 0.0;
+	    if(dx*dx + dy*dy + dz*dz < eps*eps) {
+	      if(list) list[no] = node2;
+	      no++;
+	    }
+	  }
+	}
+      }
+      if(!list) ptr[node+1] = no;
+    }
+  }
+}
+
+
+static void FindCloseNodes(struct FemType *data,Real eps,int **closeptr,int **closenodes,int info)
+/* For each node i finds the nodes j > i closer than eps, stored in the
+   compressed row format closenodes[closeptr[i]...closeptr[i+1]-1]. 
+   Only the neighbouring cells of a uniform grid need to be checked 
+   which keeps the search linear also when the nodes are not well 
+   separated in any one direction. */
+{
+  int i,noknots,*ptr,*list;
+  struct NodeGridType grid;
+
+  noknots = data->noknots;
+
+  ptr = Ivector(1,noknots+1);
+  for(i=1;i<=noknots+1;i++) ptr[i] = 0;
+  *closeptr = ptr;
+  *closenodes = NULL;
+  if(eps <= 0.0 || noknots < 2) return;
+
+  CreateNodeGrid(&grid,data,eps);
+
+  /* Two passes: first count the close nodes, then store them */
+#pragma omp parallel
+  {
+    int nthreads = 1, thread = 0;
+#ifdef _OPENMP
+    nthreads = omp_get_num_threads();
+    thread = omp_get_thread_num();
+#endif
+    CloseNodesOfCells(&grid,data,eps,(int) ((long long) grid.nocells*thread/nthreads),
+		      (int) ((long long) grid.nocells*(thread+1)/nthreads),ptr,NULL);
+  }
+
+  ptr[1] = 0;
+  for(i=1;i<=noknots;i++) 
+    ptr[i+1] += ptr[i];
+
+  if(info) printf("Found %d node pairs closer than %.3g in %d grid cells.\n",
+		  ptr[noknots+1],eps,grid.nocells);
+
+  list = Ivector(0,MAX(ptr[noknots+1],1)-1);
+  if(ptr[noknots+1]) {
+#pragma omp parallel
+    {
+      int nthreads = 1, thread = 0;
+#ifdef _OPENMP
+      nthreads = omp_get_num_threads();
+      thread = omp_get_thread_num();
+#endif
+      CloseNodesOfCells(&grid,data,eps,(int) ((long long) grid.nocells*thread/nthreads),
+			(int) ((long long) grid.nocells*(thread+1)/nthreads),ptr,list);
+    }
+  }
+
+  DestroyNodeGrid(&grid,noknots);
+  *closenodes = list;
+}
+
+
 void MergeElements(struct FemType *data,struct BoundaryType *bound,
 		   int manual,Real corder[],Real eps,int mergebounds,int info)
 {
   int i,j,k,l;
   int noelements,noknots,newnoknots,nonodes;
-  int *mergeindx=NULL,*doubles=NULL;
+  int *mergeindx=NULL,*doubles=NULL,*closeptr=NULL,*closenodes=NULL;
   Real *newx=NULL,*newy=NULL,*newz=NULL;
-  Real cx,cy,cz,dx,dy,dz,cdist,dist;
   
   ReorderElements(data,bound,manual,corder,TRUE);
 
-  /* The known ordering by vector corder[] is used to 
-     reduce the cost of finding the merged nodes. */
-
-  cx = corder[0];
-  cy = corder[1];
-  cz = corder[2];
-
-  /* Normalizing for future use */
-  cdist = sqrt(cx*cx+cy*cy+cz*cz);
-  cx /= cdist;
-  cy /= cdist;
-  cz /= cdist;
-
   noelements  = data->noelements;
   noknots = data->noknots;
   newnoknots = noknots;
@@ -6953,28 +7286,26 @@ void MergeElements(struct FemType *data,struct BoundaryType *bound,
 
   if(info) printf("Merging nodes close (%.3g) to one another.\n",eps);
 
-  dz = 0.0;
+  /* The candidate pairs are found with a grid search. Each node is then 
+     merged to the first unmerged node in the ordering closer than eps. */
+  FindCloseNodes(data,eps,&closeptr,&closenodes,info);
+
   for(i=1;i<noknots;i++) {
     if(mergeindx[i]) continue;
 
-    for(j=i+1; j<=noknots;j++) {
+    for(k=closeptr[i]; k<closeptr[i+1];k++) {
+      j = closenodes[k];
       if(mergeindx[j]) continue;
 
-      dx = data->x[i] - data->x[j];
-      dy = data->y[i] - data->y[j];
-      if(data->dim == 3) dz = data->z[i] - data->z[j];
-      if(fabs(cx*dx+cy*dy+cz*dz) > eps) break;
-
-      dist = dx*dx + dy*dy + dz*dz;
-
-      if(dist < eps*eps) {
-	doubles[i] = doubles[j] = TRUE;
-	mergeindx[j] = -i;	  
-	newnoknots--;
-      }
+      doubles[i] = doubles[j] = TRUE;
+      mergeindx[j] = -i;	  
+      newnoknots--;
     }
   }
 
+  if(closenodes) free_Ivector(closenodes,0,MAX(closeptr[noknots+1],1)-1);
+  free_Ivector(closeptr,1,noknots+1);
+
   if(mergebounds) MergeBoundaries(data,bound,doubles,info);
 
 
@@ -7196,7 +7527,7 @@ void ElementsToBoundaryConditions(struct FemType *data,
   int i,j,k,l,sideelemtype,sideelemtype2,elemind,elemind2,sideelem,sameelem;
   int sideind[MAXNODESD1],sideind2[MAXNODESD1],elemsides,side,hit,same,minelemtype;
   int sidenodes,sidenodes2,maxelemtype,elemtype,elemdim,sideelements,material;
-  int *moveelement=NULL,*parentorder=NULL,*possible=NULL,**invtopo=NULL;
+  int *moveelement=NULL,*parentorder=NULL,*possible=NULL,**invtopo=NULL,*topo;
   int noelements,maxpossible,noknots,maxelemsides,twiceelem,sideelemdim;
   int debug,unmoved,removed,elemhits;
   int notfound,*notfounds=NULL;
@@ -7471,9 +7802,20 @@ void ElementsToBoundaryConditions(struct FemType *data,
       parentorder[i] = j;
       data->material[j] = data->material[i];
       data->elementtypes[j] = data->elementtypes[i];
-      
-      for(l=0;l<k%100;l++) 
-	data->topology[j][l] = data->topology[i][l];     
+
+      /* In the compact topology the rows of different size are packed again.
+	 The target never passes the source as the elements only move down. */
+      if(data->elemtopo.created) {
+	data->elemtopo.rows[j] = data->elemtopo.rows[j-1] + k%100;
+	topo = data->elemtopo.cols + data->elemtopo.rows[j-1];
+	for(l=0;l<k%100;l++) 
+	  topo[l] = data->topology[i][l];
+	data->topology[j] = topo;
+      }
+      else {
+	for(l=0;l<k%100;l++) 
+	  data->topology[j][l] = data->topology[i][l];     
+      }
     }
     else 
       parentorder[i] = 0;
@@ -7506,14 +7848,190 @@ void ElementsToBoundaryConditions(struct FemType *data,
 
 
 
-int FindPeriodicNodes(struct FemType *data,int periodicdim[],int info)
+#define MAXPERIODICREPORT 20
+
+static void PeriodicCoordinates(struct FemType *data,int node,int skipdim,Real *periodicmap,Real *coord)
+/* Coordinates used in periodic matching: either the coordinates with the periodic 
+   direction skipped, or the coordinates mapped by the given rotation and translation. */
+{
+  Real x,y,z,xz,yz,zx,cx,cy,cz;
+
+  x = data->x[node];
+  y = data->y[node];
+  z = (data->dim == 3) ? data->z[node] : 0.0;
+
+  if(!periodicmap) {
+    coord[0] = (skipdim == 1) ? 0.0 : x;
+    coord[1] = (skipdim == 2) ? 0.0 : y;
+    coord[2] = (skipdim == 3) ? 0.0 : z;
+    return;
+  }
+
+  /* Same convention as in the rotation of the whole mesh */
+  cx = FM_PI * periodicmap[0]/180.0;
+  cy = FM_PI * periodicmap[1]/180.0;
+  cz = FM_PI * periodicmap[2]/180.0;
+
+  xz = x*cos(cz) + y*sin(cz);
+  yz = -x*sin(cz) + y*cos(cz);
+  if(data->dim == 3) {
+    coord[1] = yz*cos(cx) + z*sin(cx);
+    zx = -yz*sin(cx) + z*cos(cx);
+    coord[2] = zx*cos(cy) + xz*sin(cy);
+    coord[0] = -zx*sin(cy) + xz*cos(cy);
+  }
+  else {
+    coord[0] = xz;
+    coord[1] = yz;
+    coord[2] = 0.0;
+  }
+  coord[0] += periodicmap[3];
+  coord[1] += periodicmap[4];
+  coord[2] += periodicmap[5];
+}
+
+
+struct PeriodicPointType {
+  long long cell;
+  int ind;
+};
+
+static int ComparePeriodicPoints(const void *a,const void *b)
+{
+  const struct PeriodicPointType *c1 = (const struct PeriodicPointType *) a;
+  const struct PeriodicPointType *c2 = (const struct PeriodicPointType *) b;
+
+  if(c1->cell < c2->cell) return(-1);
+  if(c1->cell > c2->cell) return(1);
+  return(c1->ind - c2->ind);
+}
+
+
+static int MatchPeriodicNodes(struct FemType *data,int botn,int *revindbot,int topn,int *revindtop,
+			      int skipdim,Real *periodicmap,Real eps,int *match,Real *mindist)
+/* For each bottom node finds the first top node closer than eps in the matching 
+   coordinates, the same one that a loop over the top nodes would find. The top 
+   nodes are sorted by the cells of a uniform grid so that each bottom node is 
+   compared only to the top nodes in the neighbouring cells. match[i] is the 
+   index of the top node, or zero if there is none. For the first missing 
+   ones mindist[i] gives the distance to the closest top node. Returns the 
+   number of matched nodes. */
 {
-  int i,j,i2,j2,dim;
-  int noknots,hit,tothits;
-  int *topbot=NULL,*indxper=NULL;
+  int i,i2,k,n[3],hits;
+  Real lim[3],maxlim[3],h[3],coord[3],dist,dx,dy,dz;
+  Real **topcoord;
+  struct PeriodicPointType *points;
+
+  if(botn == 0 || topn == 0) return(0);
+
+  topcoord = Rmatrix(1,topn,0,2);
+  for(i=1;i<=topn;i++) 
+    PeriodicCoordinates(data,revindtop[i],periodicmap ? 0 : skipdim,NULL,topcoord[i]);
+
+  for(k=0;k<3;k++) 
+    lim[k] = maxlim[k] = topcoord[1][k];
+  for(i=2;i<=topn;i++) {
+    for(k=0;k<3;k++) {
+      lim[k] = MIN(lim[k],topcoord[i][k]);
+      maxlim[k] = MAX(maxlim[k],topcoord[i][k]);
+    }
+  }
+  for(k=0;k<3;k++) {
+    h[k] = eps;
+    if((maxlim[k]-lim[k]) / eps > 1.0e6) h[k] = (maxlim[k]-lim[k]) / 1.0e6;
+    n[k] = (int) ((maxlim[k]-lim[k]) / h[k]) + 1;
+  }
+
+  points = (struct PeriodicPointType*) malloc((size_t) topn*sizeof(struct PeriodicPointType));
+  for(i=1;i<=topn;i++) {
+    points[i-1].cell = 0;
+    for(k=0;k<3;k++) 
+      points[i-1].cell = points[i-1].cell * n[k] + 
+	MIN((int) ((topcoord[i][k]-lim[k])/h[k]),n[k]-1);
+    points[i-1].ind = i;
+  }
+  qsort(points,topn,sizeof(struct PeriodicPointType),ComparePeriodicPoints);
+
+  hits = 0;
+#pragma omp parallel for private(k,coord) reduction(+:hits) schedule(dynamic,1024)
+  for(i=1;i<=botn;i++) {
+    int d,l,lo,hi,mid,ind[3],i3,j3,best;
+    long long cmin,cmax;
+    Real r,ex,ey,ez;
+
+    PeriodicCoordinates(data,revindbot[i],skipdim,periodicmap,coord);
+
+    best = 0;
+    for(k=0;k<3;k++) {
+      r = (coord[k]-lim[k])/h[k];
+      if(r < -1.0 || r >= n[k]+1.0) break;
+      ind[k] = (int) floor(r);
+    }
+
+    if(k == 3) {
+      for(d=0;d<9;d++) {
+	i3 = ind[0] + d/3 - 1;
+	j3 = ind[1] + d%3 - 1;
+	if(i3 < 0 || i3 >= n[0] || j3 < 0 || j3 >= n[1]) continue;
+	if(ind[2]+1 < 0 || ind[2]-1 >= n[2]) continue;
+	cmin = ((long long) i3*n[1] + j3)*n[2] + MAX(ind[2]-1,0);
+	cmax = ((long long) i3*n[1] + j3)*n[2] + MIN(ind[2]+1,n[2]-1);
+
+	lo = 0;
+	hi = topn;
+	while(lo < hi) {
+	  mid = (lo+hi)/2;
+	  if(points[mid].cell < cmin) lo = mid+1;
+	  else hi = mid;
+	}
+	for(l=lo;l<topn && points[l].cell <= cmax;l++) {
+	  if(best && points[l].ind >= best) continue;
+	  ex = coord[0] - topcoord[points[l].ind][0];
+	  ey = coord[1] - topcoord[points[l].ind][1];
+	  ez = coord[2] - topcoord[points[l].ind][2];
+	  if(ex*ex+ey*ey+ez*ez < eps*eps) best = points[l].ind;
+	}
+      }
+    }
+
+    match[i] = best;
+    if(best) hits++;
+  }
+
+  /* The slow search of the closest node is only done for reporting a few missing ones */
+  k = 0;
+  for(i=1;i<=botn;i++) {
+    mindist[i] = 0.0;
+    if(match[i]) continue;
+    mindist[i] = -1.0;
+    if(++k > MAXPERIODICREPORT) continue;
+
+    PeriodicCoordinates(data,revindbot[i],skipdim,periodicmap,coord);
+    for(i2=1;i2<=topn;i2++) {
+      dx = coord[0] - topcoord[i2][0];
+      dy = coord[1] - topcoord[i2][1];
+      dz = coord[2] - topcoord[i2][2];
+      dist = sqrt(dx*dx+dy*dy+dz*dz);
+      if(mindist[i] < 0.0 || dist < mindist[i]) mindist[i] = dist;
+    }
+  }
+
+  free(points);
+  free_Rmatrix(topcoord,1,topn,0,2);
+
+  return(hits);
+}
+
+
+
+int FindPeriodicNodes(struct FemType *data,int periodicdim[],Real *periodicmap,int info)
+{
+  int i,j,j2,dim;
+  int noknots,hits,tothits,missing;
+  int *topbot=NULL,*indxper=NULL,*match=NULL;
   int botn,topn,*revindtop=NULL,*revindbot=NULL;
-  Real eps,dist,dx,dy,dz,coordmax,coordmin;
-  Real *coord=NULL,*toparr=NULL,*botarr=NULL,epsmin;
+  Real eps,coordmax,coordmin;
+  Real *coord=NULL,*mindist=NULL;
 
 
   if(data->dim < 3) periodicdim[2] = 0;
@@ -7572,8 +8090,15 @@ int FindPeriodicNodes(struct FemType *data,int periodicdim[],int info)
 	topbot[i] = 0;
       }
     }
-    
-    if(topn != botn) {
+
+    /* With a mapping the image of the bottom nodes may be any node */
+    if(periodicmap) {
+      topn = noknots;
+      if(info) printf("Mapping %d periodic nodes with rotation [%.3g %.3g %.3g] and translation [%.3g %.3g %.3g]\n",
+		      botn,periodicmap[0],periodicmap[1],periodicmap[2],
+		      periodicmap[3],periodicmap[4],periodicmap[5]);
+    }
+    else if(topn != botn) {
       printf("There should be equal number of top and bottom nodes (%d vs. %d)!\n",topn,botn);
       return(3);
     }
@@ -7581,98 +8106,69 @@ int FindPeriodicNodes(struct FemType *data,int periodicdim[],int info)
       if(info) printf("Looking for %d periodic nodes\n",topn);
     }
 
-    toparr = Rvector(1,topn);
-    botarr = Rvector(1,botn);
     revindtop = Ivector(1,topn);
     revindbot = Ivector(1,botn);
     
     topn = botn = 0;
     for(i=1;i<=noknots;i++) {
       j = topbot[i];
-      if(j > 0) {
+      if(periodicmap) {
+	topn++;
+	revindtop[topn] = i;
+      }
+      else if(j > 0) {
 	topn++;
 	revindtop[topn] = i;  
       }
-      else if(j < 0) {
-	j = abs(j);
+      if(j < 0) {
 	botn++;
 	revindbot[botn] = i;  
       }
     }
-    
-    if(data->dim == 2) {
-      for(i=1;i<=botn;i++) {
-	j = revindbot[i];
-	hit = FALSE;
-	for(i2=1;i2<=topn;i2++) {
-	  j2 = revindtop[i2];
-	  if(dim == 1) 
-	    dist = fabs(data->y[j] - data->y[j2]);
-	  else 
-	    dist = fabs(data->x[j] - data->x[j2]);
-	  if(dist < eps) {
-	    hit = TRUE;
-	    goto hit2d;
-	  }
-	}
 
-      hit2d:
-	if(hit) {
-	  tothits++;
-	  if(indxper[j] == j) indxper[j2] = j;
-	  else if(indxper[indxper[j]]==indxper[j]) {
-	    indxper[j2] = indxper[j];
-	  }
-	  else {
-	    printf("unknown 2d case!\n");
-	  }
-	}
-	else {
-	  printf("Couldn't find a periodic counterpart for node %d at [%.3g %.3g]]\n",
-		 j,data->x[j],data->y[j]);
+    match = Ivector(1,MAX(botn,1));
+    mindist = Rvector(1,MAX(botn,1));
+    hits = MatchPeriodicNodes(data,botn,revindbot,topn,revindtop,dim,periodicmap,eps,match,mindist);
+    if(info) printf("Matched %d out of %d periodic nodes\n",hits,botn);
+
+    missing = 0;
+    for(i=1;i<=botn;i++) {
+      j = revindbot[i];
+
+      if(!match[i]) {
+	missing++;
+	if(mindist[i] >= 0.0) {
+	  if(data->dim == 2) 
+	    printf("Couldn't find a periodic counterpart for node %d at [%.3g %.3g], closest at distance %.3g\n",
+		   j,data->x[j],data->y[j],mindist[i]);
+	  else 
+	    printf("Couldn't find a periodic counterpart for node %d at [%.3g %.3g %.3g], closest at distance %.3g\n",
+		   j,data->x[j],data->y[j],data->z[j],mindist[i]);
 	}
+	continue;
       }
-    }
-    else if(data->dim == 3) {
-      dx = dy = dz = 0.0;
-      for(i=1;i<=botn;i++) {
-	j = revindbot[i];
-	hit = FALSE;
-	epsmin = coordmax - coordmin;
-	
-	for(i2=1;i2<=topn;i2++) {
-	  j2 = revindtop[i2];
-	  if(dim == 1) {
-	    dy = data->y[j] - data->y[j2];
-	    dz = data->z[j] - data->z[j2];
-	  }
-	  else if(dim == 2) {
-	    dx = data->x[j] - data->x[j2];
-	    dz = data->z[j] - data->z[j2];
-	  }
-	  else {
-	    dx = data->x[j] - data->x[j2];
-	    dy = data->y[j] - data->y[j2];
-	  }
-	  if(dx*dx+dy*dy+dz*dz < eps*eps) {
-	    hit = TRUE;
-	    goto hit3d;
-	  }
-	}
 
-      hit3d:
-	if(hit) {
-	  tothits++;	  
-          indxper[j2] = indxper[j];
+      j2 = revindtop[match[i]];
+      tothits++;
+
+      if(data->dim == 2) {
+	if(indxper[j] == j) indxper[j2] = j;
+	else if(indxper[indxper[j]]==indxper[j]) {
+	  indxper[j2] = indxper[j];
 	}
 	else {
-	  printf("The periodic counterpart for node %d was not found!\n",j);
+	  printf("unknown 2d case!\n");
 	}
       }
+      else {
+	indxper[j2] = indxper[j];
+      }
     }
+    if(missing) 
+      printf("Periodic counterpart was not found for %d nodes with tolerance %.3g\n",missing,eps);
 
-    free_Rvector(toparr,1,topn);
-    free_Rvector(botarr,1,botn);
+    free_Ivector(match,1,MAX(botn,1));
+    free_Rvector(mindist,1,MAX(botn,1));
     free_Ivector(revindtop,1,topn);
     free_Ivector(revindbot,1,botn);
   }
@@ -7880,6 +8376,7 @@ int CreateBoundaryLayer(struct FemType *data,struct BoundaryType *bound,
   int *layernode=NULL,*newelementtypes=NULL,**newtopo=NULL,**oldtopo=NULL;
   int *topomap=NULL,*newmaterial=NULL,*herit=NULL,*inside=NULL,*nonlin=NULL;
   int endbcs, *endparents=NULL, *endtypes=NULL, *endnodes=NULL, *endnodes2=NULL, *endneighbours=NULL;
+  struct CRSType oldelemtopo;
 
   printf("maxfilters=%d layereps=%.3e\n",maxfilters,layereps);
 
@@ -8460,6 +8957,8 @@ omstart:
 
   free_Ivector(data->material,1,oldnoelements);
   data->material = newmaterial;
+  oldelemtopo = data->elemtopo;
+  data->elemtopo.created = FALSE;
   data->topology = newtopo;
 
 
@@ -8891,7 +9390,7 @@ omstart:
   ReorderElements(data,bound,FALSE,corder,info);
 #endif
 
-  free_Imatrix(oldtopo,1,oldnoelements,0,oldmaxnodes-1);
+  DestroyTopology(oldtopo,&oldelemtopo,oldnoelements,oldmaxnodes);
   free_Ivector(layernode,1,oldnoknots);
   free_Rvector(oldx,1,oldnoknots);
   free_Rvector(oldy,1,oldnoknots);
@@ -9374,6 +9873,7 @@ int CreateBoundaryLayerDivide(struct FemType *data,struct BoundaryType *bound,
  
   data->x = newx;
   data->y = newy;
+  FreeTopology(data);
   data->topology = newtopo;
   data->material = newmaterial;
   data->elementtypes = newelementtypes;
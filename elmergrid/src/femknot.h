@@ -20,6 +20,9 @@ void NumberVariables(struct FemType *data,int variable);
 int CalculateIndexwidth(struct FemType *data,int indxis,int *indx);
 void InitializeKnots(struct FemType *data);
 void AllocateKnots(struct FemType *data);
+void AllocateTopology(struct FemType *data,int totnodes);
+int CompactTopology(struct FemType *data,int info);
+void FreeTopology(struct FemType *data);
 void CreateKnots(struct GridType *grid,struct CellType *cell,
 		 struct FemType *data,int noknots,int info);
 int CreateVariable(struct FemType *data,int variable,int unknowns,
@@ -87,7 +90,7 @@ void MergeBoundaries(struct FemType *data,struct BoundaryType *bound,int *double
 void SeparateCartesianBoundaries(struct FemType *data,struct BoundaryType *bound,int info);
 void ElementsToBoundaryConditions(struct FemType *data,
 				  struct BoundaryType *bound,int retainorphans, int info);
-int FindPeriodicNodes(struct FemType *data,int periodicdim[],int info);
+int FindPeriodicNodes(struct FemType *data,int periodicdim[],Real *periodicmap,int info);
 int FindPeriodicParents(struct FemType *data,struct BoundaryType *bound,int info);
 int FindNewBoundaries(struct FemType *data,struct BoundaryType *bound,
 		      int *boundnodes,int suggesttype,int dimred,int info);
@@ -123,12 +123,15 @@ static void Instructions()
   printf("taken into account only when applicable to the given format.\n");
 
   printf("-out str             : name of the output file\n");
-  printf("-in str              : name of a secondary input file\n");
+  printf("-in str              : name of a secondary input file (mesh directory when fusing)\n");
   printf("-decimals            : number of decimals in the saved mesh (eg. 8)\n");
   printf("-relh real           : give relative mesh density parameter for ElmerGrid meshing\n");
   printf("-triangles           : rectangles will be divided to triangles\n");
   printf("-merge real          : merges nodes that are close to each other\n");
   printf("-order real[3]       : reorder elements and nodes using c1*x+c2*y+c3*z\n");
+  printf("-rcmorder            : reorder nodes by reverse Cuthill-McKee and elements to follow\n");
+  printf("-sfcorder            : reorder nodes along a Hilbert curve and elements to follow\n");
+  printf("-orderbench          : report bandwidth and matrix-vector timing before and after ordering\n");
   printf("-centralize          : set the center of the mesh to origin\n");
   printf("-scale real[3]       : scale the coordinates with vector real[3]\n");
   printf("-translate real[3]   : translate the nodes with vector real[3]\n");
@@ -170,12 +173,15 @@ static void Instructions()
 #if PARTMETIS
   printf("-metis int[2]        : the mesh will be partitioned with Metis\n");
 #endif
+  printf("-partsfc int[2]      : the mesh will be partitioned along a space-filling curve\n");
+  printf("                       (0 Hilbert, 1 Morton, +2 weight elements by their nodes)\n");
   printf("-partdual            : use the dual graph in the partitioning\n");
   printf("-halo                : create halo for the partitioning for DG\n");
   printf("-halobc              : create halo for the partitioning at boundaries only\n");
   printf("-haloz               : create halo for the the special z-partitioning\n");
   printf("-indirect            : create indirect connections in the partitioning\n");
   printf("-periodic int[3]     : decleare the periodic coordinate directions for parallel meshes\n");
+  printf("-periodicmap real[6] : rotation and translation mapping the lower periodic boundary to its image\n");
   printf("-partjoin int        : number of partitions in the data to be joined\n");
   printf("-saveinterval int[3] : the first, last and step for fusing parallel data\n");
   printf("-partorder real[3]   : in the above method, the direction of the ordering\n");
@@ -443,7 +449,8 @@ int main(int argc, char *argv[])
 
   case 15: 
     if(info) printf("Partitioned solution is fused on-the-fly therefore no other operations may be performed.\n");
-    FuseSolutionElmerPartitioned(eg.filesin[nofile],eg.filesout[nofile],eg.decimals,eg.partjoin,
+    FuseSolutionElmerPartitioned(eg.filesin[nofile],eg.filesout[nofile],
+				 eg.nofilesin > 1 ? eg.filesin[1] : NULL,eg.decimals,eg.partjoin,
 				 eg.saveinterval[0],eg.saveinterval[1],eg.saveinterval[2],info);
     if(info) printf("Finishing with the fusion of partitioned Elmer solutions\n");
     Goodbye();
@@ -742,16 +749,25 @@ int main(int argc, char *argv[])
     if(eg.increase) IncreaseElementOrder(&data[k],TRUE);
  
   for(k=0;k<nomeshes;k++) {
+    if(eg.orderbench) 
+      BenchmarkNodalGraph(&data[k],info);
+
     if(eg.merge) 
-      MergeElements(&data[k],boundaries[k],eg.order,eg.corder,eg.cmerge,FALSE,TRUE);
+      MergeElements(&data[k],boundaries[k],eg.order > 3 ? 0 : eg.order,eg.corder,eg.cmerge,FALSE,TRUE);
     else if(eg.order == 3) 
 #if PARTMETIS 
       ReorderElementsMetis(&data[k],TRUE);
 #else
       printf("Cannot order nodes by Metis as it is not even compiled!\n");
 #endif    
-    else if(eg.order) 
+    else if(eg.order > 0 && eg.order < 4) 
       ReorderElements(&data[k],boundaries[k],eg.order,eg.corder,TRUE);
+
+    if(eg.order == 4 || eg.order == 5) 
+      ReorderElementsLocality(&data[k],boundaries[k],eg.order-3,TRUE);
+
+    if(eg.orderbench && eg.order) 
+      BenchmarkNodalGraph(&data[k],info);
     
     if(eg.isoparam) 
       IsoparametricElements(&data[k],boundaries[k],TRUE,info);
@@ -876,7 +892,11 @@ int main(int argc, char *argv[])
     partbcoptim = eg.partbcoptim;
     partdual = eg.partdual;
 
-    if(eg.partitions || eg.metis) {
+    /* The mesh is not modified any more, so meshes with elements of different 
+       size may be packed before the graphs and the output are created. */
+    CompactTopology(&data[k],info);
+
+    if(eg.partitions || eg.metis || eg.partsfc) {
       printf("\nElmergrid partitioning meshes:\n");
       printf(  "------------------------------\n");
       timer_show();
@@ -888,7 +908,7 @@ int main(int argc, char *argv[])
 	SetConnectedNodes(&(data[k]),boundaries[k],eg.connectbounds[i-1],eg.connectboundsset[i-1],info);      
 
       if(eg.periodicdim[0] || eg.periodicdim[1] || eg.periodicdim[2]) 
-	FindPeriodicNodes(&data[k],eg.periodicdim,info);
+	FindPeriodicNodes(&data[k],eg.periodicdim,eg.periodicmap ? eg.cperiodicmap : NULL,info);
 
       if(eg.partitions) {
 	if(partopt == 0) 
@@ -900,6 +920,13 @@ int main(int argc, char *argv[])
 	else
 	  PartitionSimpleNodes(&data[k],eg.partdim,eg.periodicdim,eg.partorder,eg.partcorder,info);	
       }
+      else if(eg.partsfc) {
+	if( partopt < 0 || partopt > 3 ) {
+	  printf("Space-filling curve parameter should be in range [0,3], not %d\n",partopt);
+	  bigerror("Cannot perform partitioning");
+	}
+	PartitionSpaceFillingCurve(&data[k],eg.partsfc,partopt,info);
+      }
 #if PARTMETIS
       if(eg.metis) {
 	if( partopt < 0 || partopt > 4 ) {
@@ -230,7 +230,8 @@ struct FemType {
 
   struct CRSType dualgraph,      /* The dual graph of the finite element mesh */
     nodalgraph2,                  /* The nodal graph of the finite element mesh */
-    invtopo;                      /* The inverse of the finite element mesh topology */
+    invtopo,                      /* The inverse of the finite element mesh topology */
+    elemtopo;                     /* Compact storage of the topology, if used */
 };
 
 /* The boundaries between different materials or domains
@@ -300,6 +301,7 @@ struct ElmergridType {
     center,
     scale,      /* scale the geometry */
     order,      /* reorder the nodes */
+    orderbench, /* report bandwidth and matrix-vector timing of the node order */
     merge,      /* merge mesges */
     translate,  /* translate the mesh */
     rotate,     /* rotate the mesh */
@@ -312,6 +314,7 @@ struct ElmergridType {
     layernumber[MAXBOUNDARIES], 
     layermove,  /* map the created layer to the original geometry */
     metis,      /* number of Metis partitions */
+    partsfc,    /* number of space-filling curve partitions */
     partopt,    /* free parameter for optimization */
     partoptim,  /* apply aggressive optimization to node sharing on bulk */
     partbcoptim,  /* apply aggressive optimization to node sharing on bcs */
@@ -353,6 +356,7 @@ struct ElmergridType {
     elements3d,
     periodic, 
     periodicdim[3],
+    periodicmap,
     discont,
     discontbounds[MAXBOUNDARIES],
     connect,
@@ -381,6 +385,7 @@ struct ElmergridType {
     cmerge,
     ctranslate[3],
     crotate[3],
+    cperiodicmap[6],
     clonesize[3],
     layerratios[MAXBOUNDARIES], 
     layerthickness[MAXBOUNDARIES],
@@ -553,8 +553,48 @@ int STDCALLBULL FC_FUNC(execlinsolveprocs,EXECLINSOLVEPROCS)
 }
 
 char *mtc_domath(char *);
+char *mtc_dovalues(char *, double *, int, int *, int *);
+void mtc_setvalues(char *, double *, int, int);
+char *mtc_dovector(char *, char *, double *, int, int, double *, int *);
 void mtc_init(FILE *,FILE *, FILE *);
 
+/*--------------------------------------------------------------------------
+  INTERNAL: initialize matc for the calling thread. Each thread has an
+  interpreter context (variables, functions, output) of its own, only the
+  builtin commands and constants are shared.
+  -------------------------------------------------------------------------*/
+static int matc_been_here = 0;
+#pragma omp threadprivate(matc_been_here)
+
+static void matc_init_thread()
+{
+  char cc[32];
+
+  if ( matc_been_here==0 ) {
+    mtc_init( NULL, stdout, stderr ); 
+    strcpy( cc, "format( 12,\"rowform\")" );
+    mtc_domath( cc );
+    matc_been_here = 1;
+  }
+}
+
+/*--------------------------------------------------------------------------
+  INTERNAL: check matc output for errors, fatal unless the command was
+  given with the "nc:" prefix. Returns nonzero for an error.
+  -------------------------------------------------------------------------*/
+static int matc_check_error( char *Value, char *cmd, int start )
+{
+  if ( Value && (strncmp(Value, "MATC ERROR:",11)==0 || strncmp(Value,"WARNING:",8)==0) ) {
+    if (start==0) {
+      fprintf( stderr, "Solver input file error: %s\n", Value );
+      fprintf( stderr, "...offending input line: %s\n", cmd );
+      exit(0);
+    }
+    return 1;
+  }
+  return 0;
+}
+
 /*--------------------------------------------------------------------------
   This routine will call matc and return matc variable array values
   -------------------------------------------------------------------------*/
@@ -569,23 +609,14 @@ void STDCALLBULL FC_FUNC_(matc_get_array,MATC_GET_ARRAY) (char *name,
   -------------------------------------------------------------------------*/
 void STDCALLBULL FC_FUNC(matc,MATC) ( char *cmd, char *Value, int *len )
 {
-#define MAXLEN 8192
-
-  static int been_here = 0;
-  char *ptr, c, cc[32];
-  int slen, i, start;
-#pragma omp threadprivate(been_here)
+  char *ptr, c;
+  int slen, start;
 
   /* MB: Critical section removed since Matc library
    * modified to be thread safe */
 
    slen = *len;
-   if ( been_here==0 ) {
-     mtc_init( NULL, stdout, stderr ); 
-     strcpy( cc, "format( 12,\"rowform\")" );
-     mtc_domath( cc );
-     been_here = 1;
-   }
+   matc_init_thread();
 
   c = cmd[slen];
   cmd[slen] = '\0';
@@ -599,15 +630,9 @@ void STDCALLBULL FC_FUNC(matc,MATC) ( char *cmd, char *Value, int *len )
     strcpy( Value, (char *)ptr );
     *len = strlen(Value)-1; /* ignore linefeed! */
 
-    if ( strncmp(Value, "MATC ERROR:",11)==0 || strncmp(Value,"WARNING:",8)==0 ) {
-      if (start==0) {
-          fprintf( stderr, "Solver input file error: %s\n", Value );
-          fprintf( stderr, "...offending input line: %s\n", cmd );
-          exit(0);
-      } else {
-        Value[0]=' ';
-        *len = 0;
-        }
+    if ( matc_check_error( Value, cmd, start ) ) {
+      Value[0]=' ';
+      *len = 0;
     }
   } else {
     *len = 0;
@@ -616,6 +641,83 @@ void STDCALLBULL FC_FUNC(matc,MATC) ( char *cmd, char *Value, int *len )
   cmd[slen]=c;
   }
 
+/*--------------------------------------------------------------------------
+  This routine will call matc and return the numeric result directly in
+  values (in row order) instead of formatting it to a string. On entry n
+  is the size of values, on return the number of values in the result.
+  -------------------------------------------------------------------------*/
+void STDCALLBULL FC_FUNC(matcvalues,MATCVALUES) ( char *cmd, int *len, double *values, int *n )
+{
+#define MAXLEN 8192
+
+  char str[MAXLEN], *ptr;
+  int slen, start, nrow, ncol;
+
+  matc_init_thread();
+
+  slen = *len;
+  if ( slen >= MAXLEN ) slen = MAXLEN-1;
+  if ( slen < 0 ) slen = 0;
+  memcpy( str, cmd, slen );
+  str[slen] = '\0';
+
+  start = 0;
+  if (strncmp(str,"nc:",3)==0) start=3;
+
+  ptr = mtc_dovalues( &str[start], values, *n, &nrow, &ncol );
+  if ( matc_check_error( ptr, str, start ) ) 
+    *n = 0;
+  else
+    *n = nrow*ncol;
+}
+
+/*--------------------------------------------------------------------------
+  This routine will set a matc variable to the given n values (a row 
+  vector) without formatting them to a command
+  -------------------------------------------------------------------------*/
+void STDCALLBULL FC_FUNC(matcsetvalues,MATCSETVALUES) ( char *name, int *len, double *values, int *n )
+{
+  char str[MAX_PATH_LEN];
+  int slen;
+
+  matc_init_thread();
+
+  slen = *len;
+  if ( slen >= MAX_PATH_LEN ) slen = MAX_PATH_LEN-1;
+  memcpy( str, name, slen );
+  str[slen] = '\0';
+
+  mtc_setvalues( str, values, 1, *n );
+}
+
+/*--------------------------------------------------------------------------
+  This routine will evaluate a matc expression for n points at once. For
+  the j:th point the variable tx takes the nvar values input(1:nvar,j)
+  and the result goes to values(j). Expressions made of elementwise
+  operations are evaluated only once over all the points. On return n is
+  zero if the evaluation failed.
+  -------------------------------------------------------------------------*/
+void STDCALLBULL FC_FUNC(matcvector,MATCVECTOR) ( char *cmd, int *len, double *input, 
+          int *nvar, int *n, double *values )
+{
+  char str[MAXLEN], *ptr;
+  int slen, start, vector;
+
+  matc_init_thread();
+
+  slen = *len;
+  if ( slen >= MAXLEN ) slen = MAXLEN-1;
+  if ( slen < 0 ) slen = 0;
+  memcpy( str, cmd, slen );
+  str[slen] = '\0';
+
+  start = 0;
+  if (strncmp(str,"nc:",3)==0) start=3;
+
+  ptr = mtc_dovector( &str[start], "tx", input, *nvar, *n, values, &vector );
+  if ( matc_check_error( ptr, str, start ) ) *n = 0;
+}
+
 /*--------------------------------------------------------------------------
   INTERNAL: execute user material function
   -------------------------------------------------------------------------*/
@@ -59,6 +59,18 @@ HYPRE_IJMatrix Atilde;
 int hypre_method;
 HYPRE_Solver solver, precond;
 
+/* what the matrices were built from, checked by SolveHYPRE3 */
+unsigned long pattern;
+int precflag, bilu;
+
+/* preconditioner reuse statistics */
+int updates;     /* matrix updates since the last preconditioner setup */
+int setup_iters; /* iterations of the first solve after that setup */
+int last_iters;  /* iterations of the latest solve */
+
+/* timings of the latest matrix conversion or update and setup */
+double time_matrix, time_setup;
+
 } ElmerHypreContainer;
 
 /* If the version of HYPRE is new enough, FlexGMRES and LGMRES solvers can be included
@@ -67,12 +79,11 @@ HYPRE_Solver solver, precond;
 
 /* there are two possible procedures of calling HYPRE here, 
   the standard one (does everything once), and a step-wise
-  procedure of setup, solve and cleanup.
+  procedure of setup, solve, update and cleanup.
   The first one is obsolite. 
-  TO DO: we should add the possibility to keep the precon-
-  ditioner the same but update the system matrix (SolveHYPRE3), right now
-  calling SolveHYPRE2 solves with the matrix passed into   
-  SolveHYPRE1.
+  SolveHYPRE3 copies the values of a matrix with the same structure
+  into the objects made by SolveHYPRE1, and sets up the preconditioner
+  again only when it has become stale.
 
  standard call: - convert matrix
                 - convert vector b
@@ -381,6 +392,74 @@ void STDCALLBULL FC_FUNC(solvehypre,SOLVEHYPRE)
 
 /*///////////////////////////////////////////////////////////////////////////////////////////////*/
 
+/* Adds the local CRS rows to an IJ matrix. With bilu > 1 only the couplings
+   within each of the bilu interleaved blocks are taken. */
+static void hypre_addrows(HYPRE_IJMatrix M, int local_size, int *rows, int *cols,
+                          double *vals, int *globaldofs, int bilu)
+{
+   int nnz,irow,jcol,i,j,csize=128,*rcols;
+   double *dbuf;
+
+   rcols = (int *)malloc( csize*sizeof(int) );
+   dbuf = (double *)malloc( csize*sizeof(double) );
+   for (i = 0; i < local_size; i++) {
+     nnz = rows[i+1]-rows[i];
+     if ( nnz>csize ) {
+       csize = nnz+csize;
+       rcols = (int *)realloc( rcols, csize*sizeof(int) );
+       dbuf = (double *)realloc( dbuf, csize*sizeof(double) );
+     }
+     irow=globaldofs[i];
+     nnz = 0;
+     for (j=rows[i];j<rows[i+1];j++) {
+       jcol = globaldofs[cols[j-1]-1];
+       /*TODO - is the block ordering preserved in the linear numbering?
+	 Here we assume it is.
+       */
+       if ( bilu<=1 || (irow%bilu)==(jcol%bilu) ) {
+         rcols[nnz] = jcol;
+         dbuf[nnz] = vals[j-1];
+         nnz++;
+       }
+     }
+     HYPRE_IJMatrixAddToValues(M, 1, &nnz, &irow, rcols, dbuf);
+   }
+   free( rcols );
+   free( dbuf );
+}
+
+/* Fingerprint of the local structure and global numbering of a matrix */
+static unsigned long hypre_pattern(int local_size, int *rows, int *cols, int *globaldofs)
+{
+   unsigned long h = 5381;
+   int i;
+
+   h = 33*h + local_size;
+   for (i=0; i<local_size; i++) h = 33*h + globaldofs[i];
+   for (i=0; i<=local_size; i++) h = 33*h + rows[i];
+   for (i=0; i<rows[local_size]-1; i++) h = 33*h + cols[i];
+   return h;
+}
+
+/* Sets up the solver and preconditioner in the container for the matrix
+   parcsr_A. The vectors are only used for their layout. */
+static void hypre_setup(ElmerHypreContainer *Container, HYPRE_ParCSRMatrix parcsr_A,
+                        HYPRE_ParVector par_b, HYPRE_ParVector par_x)
+{
+   switch( Container->hypre_method / 10 ) {
+   case 0: HYPRE_ParCSRBiCGSTABSetup(Container->solver, parcsr_A, par_b, par_x); break;
+   case 1: HYPRE_BoomerAMGSetup(Container->solver, parcsr_A, par_b, par_x); break;
+   case 2: HYPRE_ParCSRPCGSetup(Container->solver, parcsr_A, par_b, par_x); break;
+   case 3: HYPRE_ParCSRGMRESSetup(Container->solver, parcsr_A, par_b, par_x); break;
+#if HAVE_GMRES
+   case 4: HYPRE_ParCSRFlexGMRESSetup(Container->solver, parcsr_A, par_b, par_x); break;
+   case 5: HYPRE_ParCSRLGMRESSetup(Container->solver, parcsr_A, par_b, par_x); break;
+#endif
+   }
+}
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+
 /* initialization for a new matrix.
       - convert matrix
       - setup solver and preconditioner
@@ -407,7 +486,7 @@ void STDCALLBULL FC_FUNC(solvehypre1,SOLVEHYPRE1)
 {
    int i, j, k, *rcols;
    int myid, num_procs;
-   int N, n, csize=128;
+   int N, n;
 
    int ilower, iupper;
    int local_size, extra;
@@ -475,90 +554,29 @@ void STDCALLBULL FC_FUNC(solvehypre1,SOLVEHYPRE1)
       Note that here we are setting one row at a time, though
       one could set all the rows together (see the User's Manual).
    */
-   {
-      int nnz,irow,i,j,k,*rcols;
-
-      rcols = (int *)malloc( csize*sizeof(int) );
-      for (i = 0; i < local_size; i++) {
-	nnz = rows[i+1]-rows[i];
-	if ( nnz>csize ) {
-	  csize = nnz+csize;
-	  rcols = (int *)realloc( rcols, csize*sizeof(int) );
-	}
-	irow=globaldofs[i];
-	for( k=0,j=rows[i]; j<rows[i+1]; j++,k++) {
-	  rcols[k] = globaldofs[cols[j-1]-1];
-	}
-	HYPRE_IJMatrixAddToValues(A, 1, &nnz, &irow, rcols, &vals[rows[i]-1]);
-      }
-      free( rcols );
-   }
+   hypre_addrows(A, local_size, rows, cols, vals, globaldofs, 1);
 
    /* Assemble after setting the coefficients */
    HYPRE_IJMatrixAssemble(A);
 
    if (!*precflag && *BILU <= 1) {
      Atilde = A;
-   } else if ( *precflag ) {
-     int nnz,irow,jcol,i,j,k,*rcols;
-     double *dbuf;
-
-     HYPRE_IJMatrixCreate(comm, ilower, iupper, ilower, iupper, &Atilde);
-     HYPRE_IJMatrixSetObjectType(Atilde, HYPRE_PARCSR);
-     HYPRE_IJMatrixInitialize(Atilde);
-     {
-        int nnz,irow,i,j,k,*rcols;
-
-        rcols = (int *)malloc( csize*sizeof(int) );
-        for (i = 0; i < local_size; i++) {
-          nnz = rows[i+1]-rows[i];
-          if ( nnz>csize ) {
-            csize = nnz+csize;
-            rcols = (int *)realloc( rcols, csize*sizeof(int) );
-          }
-          irow=globaldofs[i];
-          for( k=0,j=rows[i]; j<rows[i+1]; j++,k++) {
-             rcols[k] = globaldofs[cols[j-1]-1];
-          }
-          HYPRE_IJMatrixAddToValues(Atilde, 1, &nnz, &irow, rcols, &precvals[rows[i]-1]);
-        }
-        free( rcols );
-     }
-     /* Assemble after setting the coefficients */
-     HYPRE_IJMatrixAssemble(Atilde);     
    } else {
-     int nnz,irow,jcol,i,j,k,*rcols;
-     double *dbuf;
-     if (myid==0 && verbosity >= 5) fprintf(stdout,"HYPRE: using BILU(%d) approximation for preconditioner\n",*BILU);
-     
      HYPRE_IJMatrixCreate(comm, ilower, iupper, ilower, iupper, &Atilde);
      HYPRE_IJMatrixSetObjectType(Atilde, HYPRE_PARCSR);
      HYPRE_IJMatrixInitialize(Atilde);
-     
-     rcols = (int *)malloc( csize*sizeof(int) );
-     dbuf = (double *)malloc( csize*sizeof(double) );
-     for (i = 0; i < local_size; i++) {
-       irow=globaldofs[i];
-       nnz = 0;
-       for (j=rows[i];j<rows[i+1];j++) {
-         jcol = globaldofs[cols[j-1]-1];
-         /*TODO - is the block ordering preserved in the linear numbering?
-	   Here we assume it is.
-	 */
-         if ((irow%*BILU)==(jcol%*BILU)) {
-	   rcols[nnz] = jcol;
-           dbuf[nnz] = vals[j-1];
-           nnz++;
-	 }
-       }
-       HYPRE_IJMatrixAddToValues(Atilde, 1, &nnz, &irow, rcols, dbuf);
+     if ( *precflag ) {
+       hypre_addrows(Atilde, local_size, rows, cols, precvals, globaldofs, 1);
+     } else {
+       if (myid==0 && verbosity >= 5) fprintf(stdout,"HYPRE: using BILU(%d) approximation for preconditioner\n",*BILU);
+       hypre_addrows(Atilde, local_size, rows, cols, vals, globaldofs, *BILU);
      }
-     free( rcols );
-     free( dbuf );
      /* Assemble after setting the coefficients */
      HYPRE_IJMatrixAssemble(Atilde);     
    }
 
+   Container->time_matrix = realtime_()-st;
+
    /* Get the parcsr matrix object to use */
    /* note: this is only used for setup,  */
    /* so we put in the possibly approxima-*/
@@ -871,6 +889,14 @@ void STDCALLBULL FC_FUNC(solvehypre1,SOLVEHYPRE1)
    Container->Atilde = Atilde;
    Container->solver = solver;
    Container->precond = precond;
+
+   Container->pattern = hypre_pattern(local_size, rows, cols, globaldofs);
+   Container->precflag = *precflag;
+   Container->bilu = *BILU;
+   Container->updates = 0;
+   Container->setup_iters = -1;
+   Container->last_iters = -1;
+   Container->time_setup = realtime_()-st-Container->time_matrix;
    
    if( myid == 0 && verbosity >= 6 ) {
      fprintf( stdout, "Hypre setup time: %g\n", realtime_()-st ); 
@@ -880,16 +906,18 @@ void STDCALLBULL FC_FUNC(solvehypre1,SOLVEHYPRE1)
 
 /*////////////////////////////////////////////////////////////////////////////////////////////////*/
 
-/* solve a linear system with previously constructed solver and preconditioner */
+/* solve a linear system with previously constructed solver and preconditioner.
+   times returns the latest matrix conversion, preconditioner setup and solve
+   times, the setup time is zero if the preconditioner was reused. */
 void STDCALLBULL FC_FUNC(solvehypre2,SOLVEHYPRE2)
  (
   int *nrows, int *globaldofs, int *owner,  double *xvec,
   double *rhsvec, int *Rounds, double *TOL,
-  int *verbosityPtr, int** ContainerPtr, int *fcomm
+  int *verbosityPtr, int** ContainerPtr, int *fcomm, double *times
  )
 {
 
-   int i, j, k, *rcols;
+   int i, j, k, *rcols, num_iterations = 0;
    int myid, num_procs;
    int N, n;
 
@@ -976,10 +1004,10 @@ void STDCALLBULL FC_FUNC(solvehypre2,SOLVEHYPRE2)
 //     HYPRE_ParCSRBiCGSTABSetMaxIter(solver, *Rounds); /* max iterations */
 //     HYPRE_ParCSRBiCGSTABSetTol(solver, *TOL);       /* conv. tolerance */
      HYPRE_ParCSRBiCGSTABSolve(Container->solver, parcsr_A, par_b, par_x);
+     HYPRE_ParCSRBiCGSTABGetNumIterations(Container->solver, &num_iterations);
    }
 
    else if ( hypre_sol == 1) {
-     int num_iterations;
      double final_res_norm;
      
      HYPRE_BoomerAMGSolve(Container->solver, parcsr_A, par_b, par_x);
@@ -999,12 +1027,14 @@ void STDCALLBULL FC_FUNC(solvehypre2,SOLVEHYPRE2)
 //     HYPRE_ParCSRPCGSetMaxIter(solver, *Rounds); /* max iterations */
 //     HYPRE_ParCSRPCGSetTol(solver, *TOL);       /* conv. tolerance */
      HYPRE_ParCSRPCGSolve(Container->solver, parcsr_A, par_b, par_x);
+     HYPRE_ParCSRPCGGetNumIterations(Container->solver, &num_iterations);
    }
 
    else if ( hypre_sol == 3) {
 //     HYPRE_GMRESSetMaxIter(solver, *Rounds); /* max GMRES iterations */
 //     HYPRE_GMRESSetTol(solver, *TOL);        /* GMRES conv. tolerance */
      HYPRE_ParCSRGMRESSolve(Container->solver, parcsr_A, par_b, par_x);
+     HYPRE_ParCSRGMRESGetNumIterations(Container->solver, &num_iterations);
    }
 
 #if HAVE_GMRES
@@ -1012,15 +1042,21 @@ void STDCALLBULL FC_FUNC(solvehypre2,SOLVEHYPRE2)
 //     HYPRE_ParCSRFlexGMRESSetMaxIter(solver, *Rounds); /* max iterations */
 //     HYPRE_ParCSRFlexGMRESSetTol(solver, *TOL);       /* conv. tolerance */
      HYPRE_ParCSRFlexGMRESSolve(Container->solver, parcsr_A, par_b, par_x);
+     HYPRE_ParCSRFlexGMRESGetNumIterations(Container->solver, &num_iterations);
    }
 
    else if ( hypre_sol == 5) {
 //     HYPRE_ParCSRLGMRESSetMaxIter(solver, *Rounds); /* max iterations */
 //     HYPRE_ParCSRLGMRESSetTol(solver, *TOL);       /* conv. tolerance */
      HYPRE_ParCSRLGMRESSolve(Container->solver, parcsr_A, par_b, par_x);
+     HYPRE_ParCSRLGMRESGetNumIterations(Container->solver, &num_iterations);
    }
 #endif
 
+   /* iteration counts tell SolveHYPRE3 when the preconditioner gets stale */
+   Container->last_iters = num_iterations;
+   if ( Container->setup_iters < 0 ) Container->setup_iters = num_iterations;
+
 
    for( k=0,i=0; i<local_size; i++ )
      if ( owner[i] ) rcols[k++] = globaldofs[i];
@@ -1030,7 +1066,10 @@ void STDCALLBULL FC_FUNC(solvehypre2,SOLVEHYPRE2)
    for( i=0,k=0; i<local_size; i++ )
      if ( owner[i] ) xvec[i] = txvec[k++];
    
-   if (myid==0 && verbosity >= 5) fprintf( stdout, "solve time: %g\n", realtime_()-st );
+   times[0] = Container->time_matrix;
+   times[1] = Container->time_setup;
+   times[2] = realtime_()-st;
+   if (myid==0 && verbosity >= 5) fprintf( stdout, "solve time: %g\n", times[2] );
    free( txvec );
    free( rcols );
    
@@ -1038,11 +1077,117 @@ void STDCALLBULL FC_FUNC(solvehypre2,SOLVEHYPRE2)
    HYPRE_IJVectorDestroy(b);
 }
 
+/*////////////////////////////////////////////////////////////////////////////////////////////////*/
 
-/*TODO - add function solvehypre3 that e..g updates the matrix in the
-       Container and Krylov solver but leaves the preconditioner   
-       unchanged.
-*/
+/* update the matrix of a container made by SolveHYPRE1 in place.
+   The values are replaced if the local structure and numbering are the
+   same on all partitions, otherwise ierr=1 is returned and nothing is
+   changed. The preconditioner is set up again after setup_interval
+   updates, or earlier if the iteration count has grown by more than the
+   factor setup_growth (0 disables) since the last setup. Euclid cannot be
+   set up again and returns ierr=1 when its setup is due. */
+void STDCALLBULL FC_FUNC(solvehypre3,SOLVEHYPRE3)
+ (
+  int *nrows, int *rows, int *cols, double *vals, int *precflag, double *precvals,
+  int *globaldofs, int *owner, int *BILU, int *setup_interval, double *setup_growth,
+  int *verbosityPtr, int** ContainerPtr, int *fcomm, int *ierr
+ )
+{
+   int myid, changed, failed, recompute, local_size = *nrows;
+   int verbosity = *verbosityPtr;
+   double st, realtime_();
+   MPI_Comm comm=MPI_Comm_f2c(*fcomm);
+   ElmerHypreContainer *Container = (ElmerHypreContainer*)(*ContainerPtr);
+
+   HYPRE_ParCSRMatrix parcsr_A;
+   HYPRE_IJVector b, x;
+   HYPRE_ParVector par_b, par_x;
+
+   MPI_Comm_rank(comm, &myid);
+   *ierr = 0;
+
+   /* the decision has to be the same on all partitions */
+   changed = Container==NULL || *precflag != Container->precflag || *BILU != Container->bilu;
+   if ( !changed ) changed = hypre_pattern(local_size,rows,cols,globaldofs) != Container->pattern;
+   MPI_Allreduce(MPI_IN_PLACE, &changed, 1, MPI_INT, MPI_MAX, comm);
+   if ( changed ) {
+     if (myid==0 && verbosity >= 5) fprintf(stdout,"HYPRE: matrix structure changed, new setup\n");
+     *ierr = 1;
+     return;
+   }
+
+   Container->updates++;
+   recompute = Container->updates >= *setup_interval;
+   if ( !recompute && *setup_growth > 0 && Container->setup_iters > 0 )
+     recompute = Container->last_iters > *setup_growth * Container->setup_iters;
+
+   if ( recompute && Container->hypre_method/10 != 1 && Container->hypre_method%10 == 0 ) {
+     *ierr = 1;
+     return;
+   }
+
+   /* the values are replaced in the assembled matrices: zero them, reopen
+      them and add the local rows again. Assemble sends the contributions
+      to off-process rows to their owners, which sum them once. */
+   st = realtime_();
+   HYPRE_ClearAllErrors();
+   HYPRE_IJMatrixSetConstantValues(Container->A, 0.0);
+   HYPRE_IJMatrixInitialize(Container->A);
+   hypre_addrows(Container->A, local_size, rows, cols, vals, globaldofs, 1);
+   HYPRE_IJMatrixAssemble(Container->A);
+
+   if ( Container->Atilde != Container->A ) {
+     HYPRE_IJMatrixSetConstantValues(Container->Atilde, 0.0);
+     HYPRE_IJMatrixInitialize(Container->Atilde);
+     if ( *precflag )
+       hypre_addrows(Container->Atilde, local_size, rows, cols, precvals, globaldofs, 1);
+     else
+       hypre_addrows(Container->Atilde, local_size, rows, cols, vals, globaldofs, *BILU);
+     HYPRE_IJMatrixAssemble(Container->Atilde);
+   }
+   Container->time_matrix = realtime_()-st;
+   Container->time_setup = 0;
+
+   /* if any partition failed to update in place everything is built again */
+   failed = HYPRE_GetError() != 0;
+   MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, comm);
+   if ( failed ) {
+     if (myid==0 && verbosity >= 5) fprintf(stdout,"HYPRE: matrix update failed, new setup\n");
+     HYPRE_ClearAllErrors();
+     *ierr = 1;
+     return;
+   }
+
+   if ( !recompute ) {
+     if (myid==0 && verbosity >= 6) fprintf(stdout,"HYPRE: matrix updated, preconditioner reused\n");
+     return;
+   }
+
+   st = realtime_();
+   HYPRE_IJMatrixGetObject(Container->Atilde, (void**) &parcsr_A);
+
+   HYPRE_IJVectorCreate(comm, Container->ilower, Container->iupper,&b);
+   HYPRE_IJVectorSetObjectType(b, HYPRE_PARCSR);
+   HYPRE_IJVectorInitialize(b);
+   HYPRE_IJVectorAssemble(b);
+   HYPRE_IJVectorGetObject(b, (void **) &par_b);
+
+   HYPRE_IJVectorCreate(comm, Container->ilower, Container->iupper,&x);
+   HYPRE_IJVectorSetObjectType(x, HYPRE_PARCSR);
+   HYPRE_IJVectorInitialize(x);
+   HYPRE_IJVectorAssemble(x);
+   HYPRE_IJVectorGetObject(x, (void **) &par_x);
+
+   hypre_setup(Container, parcsr_A, par_b, par_x);
+
+   HYPRE_IJVectorDestroy(x);
+   HYPRE_IJVectorDestroy(b);
+
+   Container->updates = 0;
+   Container->setup_iters = -1;
+   Container->time_setup = realtime_()-st;
+   if (myid==0 && verbosity >= 6) fprintf(stdout,"HYPRE: matrix updated, preconditioner set up again\n");
+}
 
 /* destroy HYPRE data structure stored in a fortran environment */
 void STDCALLBULL FC_FUNC(solvehypre4,SOLVEHYPRE4)(int** ContainerPtr) {
@@ -1094,6 +1239,7 @@ void STDCALLBULL FC_FUNC(solvehypre4,SOLVEHYPRE4)(int** ContainerPtr) {
    if (Container->Atilde != Container->A) {
      HYPRE_IJMatrixDestroy(Container->Atilde);
    }
+   HYPRE_IJMatrixDestroy(Container->A);
    free(Container);
    *ContainerPtr = NULL;
 }
@@ -18,6 +18,14 @@ To activate these linear solvers, set
 
 see elmerfem/fem/examples/trilinos for an example.
 
+When 'Linear System Refactorize' is set, a matrix with an unchanged
+sparsity pattern is not rebuilt: its values are replaced in place
+(SolveTrilinos3) and the preconditioner is recomputed only every
+"Preconditioner Recompute Interval" updates (default 1), or earlier
+if the iteration count has grown by more than the factor
+"Preconditioner Recompute Growth" (default 2.0, 0 disables) since
+the last recomputation. Both are read from the xml file.
+
 */
 
 #include "../config.h"
@@ -77,6 +85,9 @@ if (ierr) {std::cout<<"Trilinos Error "<<ierr<<" returned from call "<<#funcall<
 #include "Epetra_CrsMatrix.h"
 #include "Epetra_Operator.h"
 
+#include <vector>
+#include <algorithm>
+
 #include "Teuchos_RCP.hpp"
 #include "Teuchos_ParameterList.hpp"
 #include "Teuchos_XMLParameterListHelpers.hpp"
@@ -132,6 +143,7 @@ Teuchos::RCP<Epetra_Map> assemblyMap_; // map with 'overlap' of nodes
 Teuchos::RCP<Epetra_Map> solveMap_; // map with each node on one proc
 Teuchos::RCP<Epetra_Export> exporter_;
 Teuchos::RCP<Epetra_CrsMatrix> matrix_;
+Teuchos::RCP<Epetra_CrsMatrix> elmerMatrix_; // matrix with overlap, kept for value updates
 Teuchos::RCP<Epetra_Vector> rhs_;
 Teuchos::RCP<Epetra_Vector> sol_;
 Teuchos::RCP<Epetra_MultiVector> coords_; // node coordinates can be used by ML
@@ -144,6 +156,18 @@ Teuchos::RCP<Teuchos::ParameterList> params_;
 Teuchos::RCP<Epetra_Operator> prec_;
 Teuchos::RCP<Belos::SolverManager<ST,MV,OP> > solver_;
 
+// Elmer CRS structure the matrices were built for, and the local column
+// indices of its entries in elmerMatrix_, used by SolveTrilinos3
+std::vector<int> rows_, cols_, elmerLIDs_;
+
+// preconditioner reuse policy and statistics
+int recomputeInterval_;
+double recomputeGrowth_;
+int updatesSinceSetup_; // matrix updates since the preconditioner was computed
+int setupIters_;        // iterations of the first solve after that
+int lastIters_;         // iterations of the latest solve
+bool lastConverged_;
+
 Teuchos::RCP<struct ElmerTrilinosContainer> previous_;
 Teuchos::RCP<struct ElmerTrilinosContainer> next_;
 
@@ -184,6 +208,9 @@ Teuchos::RCP<Epetra_Operator> createMLPreconditioner(
         Teuchos::RCP<Epetra_CrsMatrix> A, Teuchos::ParameterList& params,
         Teuchos::RCP<Epetra_MultiVector> coords);
 
+// recomputes an existing preconditioner for new matrix values
+int recomputePreconditioner(Teuchos::RCP<Epetra_Operator> prec);
+
 Teuchos::RCP<Belos::SolverManager<ST,MV,OP> > createSolver
         (Teuchos::RCP<OP> A, Teuchos::RCP<OP> P,
         Teuchos::RCP<MV> x, Teuchos::RCP<MV> b,
@@ -494,12 +521,33 @@ try {
    Container->solveMap_=solveMap;
    Container->exporter_=exporter;
    Container->matrix_=A;
+   Container->elmerMatrix_=A_elmer;
    Container->coords_=coords;
    Container->scaleFactor_=scaleFactor;
    Container->rhs_=rhs;
    Container->sol_=sol;
   Container->prec_=prec;
   Container->solver_=solver;
+
+  // keep the structure so that later matrices with the same pattern
+  // can be copied into the existing objects by SolveTrilinos3
+  // (note that rows is one-based, so *nnz is one more than the entries)
+  int nz = rows[*n]-1;
+  Container->rows_.assign(rows,rows+*n+1);
+  Container->cols_.assign(cols,cols+nz);
+  Container->elmerLIDs_.resize(nz);
+  const Epetra_Map& elmerColMap = A_elmer->ColMap();
+  for (int i=0;i<nz;i++)
+    {
+    Container->elmerLIDs_[i] = elmerColMap.LID(assemblyMap->GID(cols[i]-1));
+    }
+
+  Container->recomputeInterval_ = params->get("Preconditioner Recompute Interval",1);
+  Container->recomputeGrowth_ = params->get("Preconditioner Recompute Growth",2.0);
+  Container->updatesSinceSetup_=0;
+  Container->setupIters_=-1;
+  Container->lastIters_=-1;
+  Container->lastConverged_=true;
   
 #ifdef DEBUG_TRILINOS_INTERFACE
   Container->memtest_=Teuchos::rcp(new MemTest());
@@ -608,6 +656,11 @@ if (!success)
   return;
   }
 
+    // iteration counts drive the preconditioner reuse in SolveTrilinos3
+    Container->lastIters_ = solver->getNumIters();
+    Container->lastConverged_ = (ret==Belos::Converged);
+    if (Container->setupIters_<0) Container->setupIters_=Container->lastIters_;
+
     // check for loss of accuracy
     bool loa = solver->isLOADetected();
 
@@ -692,6 +745,100 @@ if (!success)
 return;
 }
 
+////////////////////////////////////////////////////////////
+// update the matrix values                               //
+////////////////////////////////////////////////////////////
+
+// Replaces the values of the matrix set up by SolveTrilinos1 by those of a
+// new matrix with the same structure, and recomputes the preconditioner if
+// the reuse policy asks for it. Returns ierr=1 if the structure differs, in
+// which case nothing is changed and the container has to be rebuilt.
+void SolveTrilinos3
+ (
+  int *n, int *nnz,
+  int *rows, int *cols, double *vals,
+  int *verbosityPtr, int** ContainerPtr,
+  int *returnCode
+ )
+  {
+  int verbose = *verbosityPtr;
+  int& ierr=*returnCode;
+  ierr=0;
+  bool success=true;
+
+ElmerTrilinosContainer* Container = (ElmerTrilinosContainer*)(*ContainerPtr);
+if (Container==NULL) ERROR("invalid pointer passed to SolveTrilinos3",__FILE__,__LINE__);
+
+  am_printer = (Container->comm_->MyPID()==0)&&(verbose>PRINTLEVEL);
+
+  if (*n+1 != (int)Container->rows_.size() || rows[*n]-1 != (int)Container->cols_.size() ||
+      !std::equal(Container->rows_.begin(),Container->rows_.end(),rows) ||
+      !std::equal(Container->cols_.begin(),Container->cols_.end(),cols))
+    {
+    OUT("matrix structure has changed, Trilinos objects have to be rebuilt");
+    ierr=1;
+    return;
+    }
+
+  Teuchos::RCP<Epetra_CrsMatrix> A_elmer = Container->elmerMatrix_;
+  Teuchos::RCP<Epetra_CrsMatrix> A = Container->matrix_;
+
+  try {
+  // copy the new values into the overlapping matrix, row by row
+  for (int i=0;i<*n;i++)
+    {
+    int k = rows[i]-1;
+    CHECK_ZERO(A_elmer->ReplaceMyValues(i,rows[i+1]-rows[i],&(vals[k]),
+        &(Container->elmerLIDs_[k])));
+    }
+
+  // and sum them up in the non-overlapping one
+  CHECK_ZERO(A->PutScalar(0.0));
+  CHECK_ZERO(A->Export(*A_elmer, *(Container->exporter_), Add));
+  if (Container->scaleFactor_!=1.0) CHECK_ZERO(A->Scale(Container->scaleFactor_));
+  } TEUCHOS_STANDARD_CATCH_STATEMENTS(true,std::cerr,success)
+
+  if (!success)
+    {
+    WARNING("Failed to update matrix",__FILE__,__LINE__);
+    ierr = -1;
+    return;
+    }
+
+  OUT("matrix values updated");
+
+  Container->updatesSinceSetup_++;
+
+  bool recompute = (Container->updatesSinceSetup_ >= Container->recomputeInterval_)
+        || !Container->lastConverged_;
+  if (!recompute && Container->recomputeGrowth_>0.0 && Container->setupIters_>0)
+    {
+    recompute = Container->lastIters_ > Container->recomputeGrowth_*Container->setupIters_;
+    }
+
+  if (recompute && Container->prec_!=Teuchos::null)
+    {
+    OUT("recompute preconditioner");
+    try {
+    CHECK_ZERO(recomputePreconditioner(Container->prec_));
+    } TEUCHOS_STANDARD_CATCH_STATEMENTS(true,std::cerr,success)
+
+    if (!success)
+      {
+      WARNING("Failed to recompute preconditioner",__FILE__,__LINE__);
+      ierr = -1;
+      return;
+      }
+    Container->updatesSinceSetup_=0;
+    Container->setupIters_=-1;
+    }
+  else
+    {
+    OUT("reuse preconditioner");
+    }
+  return;
+  }
+
 ////////////////////////////////////////////////////////////
 // destructor                                             //
 ////////////////////////////////////////////////////////////
@@ -983,6 +1130,24 @@ Teuchos::RCP<Epetra_Operator> createMLPreconditioner(
     }
   return prec;
   }
+
+// Recomputes a preconditioner made by createPreconditioner after the values
+// of its matrix have changed. The symbolic setup of Ifpack is kept, ML
+// rebuilds its hierarchy. Any other operator cannot be updated in place and
+// a nonzero value is returned, so that the caller rebuilds the container.
+int recomputePreconditioner(Teuchos::RCP<Epetra_Operator> prec)
+  {
+  Teuchos::RCP<Ifpack_Preconditioner> ifPrec =
+        Teuchos::rcp_dynamic_cast<Ifpack_Preconditioner>(prec);
+  if (ifPrec!=Teuchos::null) return ifPrec->Compute();
+
+  Teuchos::RCP<ML_Epetra::MultiLevelPreconditioner> mlPrec =
+        Teuchos::rcp_dynamic_cast<ML_Epetra::MultiLevelPreconditioner>(prec);
+  if (mlPrec!=Teuchos::null) return mlPrec->ComputePreconditioner(false);
+
+  WARNING("preconditioner type cannot be recomputed in place",__FILE__,__LINE__);
+  return -1;
+  }
                                                                                   
 // create an iterative solver for the linear system Ax=b,
 // preconditioned by P.
@@ -14,17 +14,8 @@ typedef struct {
 } cholmod;
 
 
-cholmod STDCALLBULL *FC_FUNC_(cholmod_ffactorize,CHOLMOD_FFACTORIZE)(int *n,int *rows,int *cols,double *vals)
+static void cholmod_setmatrix(cholmod *handle,int *n,int *rows,int *cols,double *vals)
 {
-  static double *y;
-  int i,j,nz,ok,*p,*q;
-  double *xx,*bx;
-
-  cholmod *handle;
-
-  handle = (cholmod *)calloc(sizeof(cholmod),1);
-  cholmod_start(&handle->c);
-
   handle->a.nrow=*n;
   handle->a.ncol=*n;
   handle->a.p=rows;
@@ -35,13 +26,47 @@ cholmod STDCALLBULL *FC_FUNC_(cholmod_ffactorize,CHOLMOD_FFACTORIZE)(int *n,int
   handle->a.stype=-1;
   handle->a.nzmax=rows[*n];
   handle->a.xtype=CHOLMOD_REAL;
+}
 
+/* Ordering and symbolic analysis only; the result depends just on the pattern */
+cholmod STDCALLBULL *FC_FUNC_(cholmod_fanalyze,CHOLMOD_FANALYZE)(int *n,int *rows,int *cols,double *vals)
+{
+  cholmod *handle;
+
+  handle = (cholmod *)calloc(sizeof(cholmod),1);
+  cholmod_start(&handle->c);
+
+  cholmod_setmatrix(handle,n,rows,cols,vals);
   handle->l=cholmod_analyze(&handle->a,&handle->c);
-  cholmod_factorize(&handle->a,handle->l,&handle->c);
 
   return handle;
 }
 
+/* Numeric factorization of a matrix with the pattern given to cholmod_fanalyze */
+void STDCALLBULL FC_FUNC_(cholmod_fnumeric,CHOLMOD_FNUMERIC)(cholmod **handle,int *n,int *rows,int *cols,double *vals)
+{
+  cholmod_setmatrix(*handle,n,rows,cols,vals);
+  cholmod_factorize(&(*handle)->a,(*handle)->l,&(*handle)->c);
+}
+
+cholmod STDCALLBULL *FC_FUNC_(cholmod_ffactorize,CHOLMOD_FFACTORIZE)(int *n,int *rows,int *cols,double *vals)
+{
+  cholmod *handle;
+
+  handle = FC_FUNC_(cholmod_fanalyze,CHOLMOD_FANALYZE)(n,rows,cols,vals);
+  FC_FUNC_(cholmod_fnumeric,CHOLMOD_FNUMERIC)(&handle,n,rows,cols,vals);
+
+  return handle;
+}
+
+/* Free the numeric values of the factor but keep the symbolic analysis */
+void STDCALLBULL FC_FUNC_(cholmod_ffree_numeric,CHOLMOD_FFREE_NUMERIC)(cholmod **handle)
+{
+  cholmod_factor *l = (*handle)->l;
+
+  cholmod_change_factor(CHOLMOD_PATTERN,l->is_ll,l->is_super,1,1,l,&(*handle)->c);
+}
+
 void STDCALLBULL FC_FUNC_(cholmod_fsolve,CHOLMOD_FSOLVE)(cholmod **handle,int *n,double *x, double *b)
 {
   double *xx,*bb;
@@ -0,0 +1,54 @@
+SUBROUTINE MeshEdgesFaces( Model,Solver,dt,TransientSimulation )
+!------------------------------------------------------------------------------
+!******************************************************************************
+!
+!  Create the edges and faces of the mesh and store their total number
+!  in the solver variable. The time taken is reported at output level 4,
+!  so a larger mesh may also be used for timing FindMeshEdges.
+!
+!  ARGUMENTS:
+!
+!  TYPE(Model_t) :: Model,  
+!     INPUT: All model information (mesh, materials, BCs, etc...)
+!
+!  TYPE(Solver_t) :: Solver
+!     INPUT: Linear & nonlinear equation solver options
+!
+!  REAL(KIND=dp) :: dt,
+!     INPUT: Timestep size for time dependent simulations
+!
+!  LOGICAL :: TransientSimulation
+!     INPUT: Steady state or transient simulation
+!
+!******************************************************************************
+  USE DefUtils
+
+  IMPLICIT NONE
+!------------------------------------------------------------------------------
+  TYPE(Solver_t) :: Solver
+  TYPE(Model_t) :: Model
+
+  REAL(KIND=dp) :: dt
+  LOGICAL :: TransientSimulation
+!------------------------------------------------------------------------------
+! Local variables
+!------------------------------------------------------------------------------
+  TYPE(Mesh_t), POINTER :: Mesh
+  REAL(KIND=dp) :: t0, RealTime
+!------------------------------------------------------------------------------
+  Mesh => Solver % Mesh
+
+  t0 = RealTime()
+  CALL FindMeshEdges( Mesh )
+  t0 = RealTime() - t0
+
+  WRITE( Message, '(A,I0,A,I0,A,I0,A)' ) 'Elements: ', Mesh % NumberOfBulkElements, &
+      ', edges: ', Mesh % NumberOfEdges, ', faces: ', Mesh % NumberOfFaces
+  CALL Info( 'MeshEdgesFaces', Message, Level=4 )
+  WRITE( Message, '(A,F10.3,A)' ) 'FindMeshEdges time (s): ', t0
+  CALL Info( 'MeshEdgesFaces', Message, Level=4 )
+
+  Solver % Variable % Values = Mesh % NumberOfEdges + Mesh % NumberOfFaces
+!------------------------------------------------------------------------------
+END SUBROUTINE MeshEdgesFaces
+!------------------------------------------------------------------------------
@@ -0,0 +1,5 @@
+include(${TEST_SOURCE}/../test_macros.cmake)
+
+execute_process(COMMAND ${ELMERGRID_BIN} 1 2 cube)
+
+RUN_ELMER_TEST()
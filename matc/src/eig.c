@@ -226,15 +226,21 @@ void vbcalc(x,v,b,beg,end)
 
 #define H(i,j) h[(i) * N + (j)]
 
+/*
+ * Below this many multiply-adds an update of hesse() stays on one thread.
+ */
+#define HESSE_PARALLEL 100000
+
 void hesse(h, DIM, N)
      int DIM, N;
      double *h;
 {
-  double *v, *x, b, s;
+  double *v, *x, *w, b, s;
   int i, j, k;
 
   x = (double *)ALLOCMEM(DIM * sizeof(double));
   v = (double *)ALLOCMEM(DIM * sizeof(double));
+  w = (double *)ALLOCMEM(DIM * sizeof(double));
 
   for (i = 0; i < DIM - 2; i++)
   {
@@ -252,6 +258,7 @@ void hesse(h, DIM, N)
     }
     v[i+1] = b * v[i+1] * v[i+1];
 
+#pragma omp parallel for private(s,k) if ((double)DIM*(DIM-i) > HESSE_PARALLEL)
     for(j = 0; j < DIM; j++)
     {
       s = 0.0;
@@ -262,18 +269,23 @@ void hesse(h, DIM, N)
 	H(j,k) = H(j,k) - s * x[k];
     }
 
-    for(j = 0; j < DIM; j++)
-    {
-      s = H(i+1,j);
-      for(k = i + 2; k < DIM; k++)
-	s = s + H(k,j) * x[k];
-      for(k = i + 1; k < DIM; k++)
-	H(k,j) = H(k,j) - s * v[k];
-    }
+/*
+ *   Column sums s(j) = H(i+1,j) + sum(H(k,j)*x(k)) accumulated a row
+ *   at a time, so that H is traversed along its rows.
+ */
+    for(j = 0; j < DIM; j++) w[j] = H(i+1,j);
+    for(k = i + 2; k < DIM; k++)
+      for(j = 0; j < DIM; j++)
+	w[j] = w[j] + H(k,j) * x[k];
+
+#pragma omp parallel for private(j) if ((double)DIM*(DIM-i) > HESSE_PARALLEL)
+    for(k = i + 1; k < DIM; k++)
+      for(j = 0; j < DIM; j++)
+	H(k,j) = H(k,j) - w[j] * v[k];
 
     for(j = i + 2; j < DIM; j++) H(j,i) = 0;
   }
-  FREEMEM((char *)x); FREEMEM((char *)v);
+  FREEMEM((char *)x); FREEMEM((char *)v); FREEMEM((char *)w);
 
   return;
 }
@@ -9,6 +9,17 @@
 char *doread( void );
 VARIABLE *com_quit( void );
 
+char *mtc_domath( char * );
+int mtc_compile( char * );
+char *mtc_evaluate( int );
+void mtc_cache( int );
+char *mtc_dovalues( char *, double *, int, int *, int * );
+void mtc_setvalues( char *, double *, int, int );
+char *mtc_dovector( char *, char *, double *, int, int, double *, int * );
+MATC_CONTEXT *mtc_context_new( FILE *, FILE *, FILE * );
+MATC_CONTEXT *mtc_context_set( MATC_CONTEXT * );
+void mtc_context_free( MATC_CONTEXT * );
+
 /*
  * $Id: fnames.h,v 1.2 2007/06/08 08:12:19 jpr Exp $ 
  *
@@ -51,12 +62,15 @@ void *mem_alloc(size_t);
 VARIABLE *evaltree(  TREE *);
 VARIABLE *evaltreelist(  TREE *);
 VARIABLE *evalclause(  CLAUSE *);
+int vec_check( TREE *, char *, int );
+VARIABLE *evalvector( TREE *, char *, VARIABLE * );
 
 VARIABLE *put_values( VARIABLE *, char *, VARIABLE *);
 VARIABLE *put_result( VARIABLE *, char *, VARIABLE *, int, int);
 
 /* files.c */
 
+void fil_init(void);
 void fil_com_init(void);
 VARIABLE *fil_fscanf( VARIABLE *);
 VARIABLE *fil_fprintf( VARIABLE *);
@@ -91,6 +105,10 @@ void lst_free( int, LIST *);
 LIST *lst_find( int, char *);
 void lst_purge( int);
 VARIABLE *lst_print( int);
+VARIABLE *lst_stat( VARIABLE * );
+void lst_share( int );
+void *lst_index_swap( void * );
+void lst_index_free( void * );
 
 
 /* matrix.c */
@@ -181,6 +199,7 @@ void free_treeentry( TREEENTRY *);
 void free_tree( TREE *);
 void free_clause( CLAUSE *);
 
+CLAUSE *parseline( char *);
 VARIABLE *doit( char *);
 
 /* printclause.c */
@@ -201,6 +220,7 @@ void var_com_init( void);
 VARIABLE *var_check( char *);
 VARIABLE *var_varlist( void);
 void var_print( VARIABLE *);
+void var_format_swap( int * );
 
 VARIABLE *var_temp_copy( VARIABLE *);
 VARIABLE *var_temp_new( int, int, int);
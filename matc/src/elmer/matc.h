@@ -296,6 +296,13 @@ typedef struct treeentry
 #define ETYPE_CONST  4
 #define ETYPE_EQUAT  5
 
+/*
+ *   result classes of vec_check() in eval.c
+ */
+#define VEC_NONE   -1     /* not evaluable elementwise       */
+#define VEC_SCALAR  0     /* does not depend on the input    */
+#define VEC_ROW     1     /* one value for each input point  */
+
 /*
  *   four leaf tree, isn't that odd
  */
@@ -339,6 +346,16 @@ typedef struct clause
 
 #define LINK(ptr)  (ptr)->link
 
+/*******************************************************************
+                      INTERPRETER CONTEXTS
+*******************************************************************/
+
+/*
+    state of an interpreter while some other one is in use on the 
+    thread, see mtc_context_new() in matc.c
+*/
+typedef struct matc_context MATC_CONTEXT;
+
 /*******************************************************************
                            THIS AND THAT
 *******************************************************************/
@@ -390,6 +407,13 @@ EXT jmp_buf *jmpbuf;
 EXT int term;
 #pragma omp threadprivate(term)
 
+/*
+     results are not printed when they are returned as values,
+     see mtc_dovalues() in matc.c
+*/
+EXT int math_quiet;
+#pragma omp threadprivate(math_quiet)
+
 #ifdef VAX
 struct desc
 { 
@@ -413,6 +413,198 @@ VARIABLE *evaltree(root) TREE *root;
   return res;
 }
 
+/*
+ *  Elementwise evaluation of an expression over arrays of points, see
+ *  mtc_dovector() in matc.c. The input VARIABLE is a n x nvar matrix, 
+ *  row j holding the values of the input variable for the j:th point.
+ *  The expression is evaluated once, each reference to the input being
+ *  replaced by the 1 x n row of its values at all the points. This is 
+ *  the same as evaluating the expression point by point only if it is
+ *  built of elementwise operations, vec_check() tells if it is.
+ */
+static int vec_index( TREE *root, int nvar )
+{
+  TREE *arg = ARGS(root);
+  int k;
+
+  if ( arg == NULL ) return nvar == 1 ? 0 : -1;
+
+  if ( NEXT(arg) || LINK(arg) || SUBS(arg) || ETYPE(arg) != ETYPE_NUMBER ) return -1;
+
+  k = (int)DDATA(arg);
+  if ( k != DDATA(arg) || k < 0 || k >= nvar ) return -1;
+
+  return k;
+}
+
+int vec_check( TREE *root, char *name, int nvar )
+/*======================================================================
+?  Check if an expression tree may be evaluated elementwise over rows
+|  of values of the input variable name (having nvar components at each
+|  point) with evalvector(). Accepted are numbers, scalar variables, 
+|  components of the input variable, pointwise builtin functions and
+|  elementwise operators.
+|
+=  VEC_NONE if not, VEC_SCALAR if the result does not depend on the
+|  input, VEC_ROW otherwise.
+^=====================================================================*/
+{
+  COMMAND *com;
+  VARIABLE *var;
+  TREE *arg;
+  MATRIX *(*opr)();
+  int left = VEC_SCALAR, right, argcount;
+
+  if ( root == NULL || LINK(root) || SUBS(root) ) return VEC_NONE;
+
+  switch( ETYPE(root) )
+  {
+    case ETYPE_NUMBER:
+      return VEC_SCALAR;
+
+    case ETYPE_CONST:
+      var = CDATA(root);
+      if ( TYPE(var) == TYPE_DOUBLE && NROW(var)*NCOL(var) == 1 ) return VEC_SCALAR;
+      return VEC_NONE;
+
+    case ETYPE_EQUAT:
+      return vec_check( LEFT(root), name, nvar );
+
+    case ETYPE_NAME:
+      if ( (com = com_check(SDATA(root))) != (COMMAND *)NULL )
+      {
+        if ( !(com->flags & CMDFLAG_PW) ) return VEC_NONE;
+
+        /* com_pointw() wants all arguments of the same size */
+        argcount = 0;
+        for( arg = ARGS(root); arg; arg = NEXT(arg) )
+        {
+          right = vec_check( arg, name, nvar );
+          if ( right == VEC_NONE || (argcount > 0 && right != left) ) return VEC_NONE;
+          left = right;
+          argcount++;
+        }
+        if ( argcount < com->minp || argcount > com->maxp ) return VEC_NONE;
+        return left;
+      }
+
+      if ( strcmp( SDATA(root), name ) == 0 )
+        return vec_index( root, nvar ) >= 0 ? VEC_ROW : VEC_NONE;
+
+      var = var_check( SDATA(root) );
+      if ( var && ARGS(root) == NULL && TYPE(var) == TYPE_DOUBLE && NROW(var)*NCOL(var) == 1 )
+        return VEC_SCALAR;
+      return VEC_NONE;
+
+    case ETYPE_OPER:
+      opr = VDATA(root);
+      if ( (left = vec_check( LEFT(root), name, nvar )) == VEC_NONE ) return VEC_NONE;
+
+      if ( opr == opr_minus || opr == opr_not )
+        return RIGHT(root) == NULL ? left : VEC_NONE;
+
+      if ( (right = vec_check( RIGHT(root), name, nvar )) == VEC_NONE ) return VEC_NONE;
+
+      /* matrix power unless the exponent is a scalar */
+      if ( opr == opr_pow ) return right == VEC_SCALAR ? left : VEC_NONE;
+
+      if ( opr == opr_add || opr == opr_subs || opr == opr_mul || opr == opr_pmul ||
+           opr == opr_div || opr == opr_lt   || opr == opr_le  || opr == opr_gt   ||
+           opr == opr_ge  || opr == opr_eq   || opr == opr_neq || opr == opr_and  ||
+           opr == opr_or )
+        return max( left, right );
+
+      return VEC_NONE;
+  }
+
+  return VEC_NONE;
+}
+
+VARIABLE *evalvector( TREE *root, char *name, VARIABLE *input )
+/*======================================================================
+?  Evaluate an expression tree accepted by vec_check() elementwise over
+|  the points given as rows of the input VARIABLE.
+|
+=  temporary 1 x n VARIABLE, or 1 x 1 if the result does not depend on 
+|  the input.
+&  var_temp_new(), var_delete_temp(), com_pointw()
+^=====================================================================*/
+{
+  VARIABLE *res, *par, *tmp;
+  COMMAND *com;
+  TREE *arg;
+  MATRIX *opres;
+  int i, k, n = NROW(input);
+
+  res = NULL;
+
+  switch( ETYPE(root) )
+  {
+    case ETYPE_NUMBER:
+      res = var_temp_new( TYPE_DOUBLE, 1, 1 );
+      M(res,0,0) = DDATA(root);
+      break;
+
+    case ETYPE_CONST:
+      res = (VARIABLE *)ALLOCMEM(VARIABLESIZE);
+      res->this = CDATA(root)->this;
+      REFCNT(res)++;
+      break;
+
+    case ETYPE_EQUAT:
+      res = evalvector( LEFT(root), name, input );
+      break;
+
+    case ETYPE_NAME:
+      if ( (com = com_check(SDATA(root))) != (COMMAND *)NULL )
+      {
+        par = tmp = NULL;
+        for( arg = ARGS(root); arg; arg = NEXT(arg) )
+        {
+          if ( par == NULL )
+            par = tmp = evalvector( arg, name, input );
+          else
+          {
+            NEXT(tmp) = evalvector( arg, name, input );
+            tmp = NEXT(tmp);
+          }
+        }
+        res = com_pointw( (double (*)())com->sub, par );
+        var_delete_temp( par );
+      }
+      else if ( strcmp( SDATA(root), name ) == 0 )
+      {
+        k = vec_index( root, NCOL(input) );
+        res = var_temp_new( TYPE_DOUBLE, 1, n );
+        for( i = 0; i < n; i++ ) M(res,0,i) = M(input,i,k);
+      }
+      else
+      {
+        tmp = var_check( SDATA(root) );
+        res = (VARIABLE *)ALLOCMEM(VARIABLESIZE);
+        res->this = tmp->this;
+        REFCNT(res)++;
+      }
+      break;
+
+    case ETYPE_OPER:
+      par = evalvector( LEFT(root), name, input );
+      tmp = RIGHT(root) ? evalvector( RIGHT(root), name, input ) : NULL;
+
+      opres = (*VDATA(root))( par->this, tmp ? tmp->this : NULL );
+
+      var_delete_temp( par );
+      var_delete_temp( tmp );
+
+      res = (VARIABLE *)ALLOCMEM(VARIABLESIZE);
+      res->this = opres;
+      REFCNT(res) = 1;
+      break;
+  }
+
+  return res;
+}
+
 VARIABLE *evalclause(root) CLAUSE *root;
 /*======================================================================
 ?  Evaluate the operations list. The list contains equations trees
@@ -928,7 +1120,7 @@ VARIABLE *put_result(ptr, resname, par, indexflag, printflag)
   }
 
   if ( res ) res->changed = 1;
-  if (printflag) var_print(res);
+  if (printflag && !math_quiet) var_print(res);
 
   return res;
 }
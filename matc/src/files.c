@@ -561,6 +561,17 @@ VARIABLE *fil_load(ptr) VARIABLE *ptr;
   return res;
 }
    
+void fil_init()
+/*======================================================================
+?  Set the standard streams of the calling thread, the commands are
+|  added by fil_com_init() once for all the threads.
+^=====================================================================*/
+{
+  fil_fps[0] = fil_fps_save[0] = stdin;
+  fil_fps[1] = fil_fps_save[1] = stdout; 
+  fil_fps[2] = fil_fps_save[2] = stderr;
+}
+
 void fil_com_init()
 {
   static char *freadHelp =
@@ -681,7 +692,5 @@ void fil_com_init()
   com_init( "save",    FALSE, FALSE, fil_save,    2, 3, saveHelp    );
   com_init( "load",    FALSE, FALSE, fil_load,    1, 1, loadHelp    );
 
-  fil_fps[0] = fil_fps_save[0] = stdin;
-  fil_fps[1] = fil_fps_save[1] = stdout; 
-  fil_fps[2] = fil_fps_save[2] = stderr;
+  fil_init();
 }
@@ -240,6 +240,8 @@ void fnc_free_entry(fnc) FUNCTION *fnc;
     FREEMEM((char *)fnc -> exports);  /* name array */
   }
 
+  if (fnc -> help) FREEMEM(fnc -> help);  /* help text */
+
   lst_free(FUNCTIONS, (LIST *)fnc);
 }
 
@@ -97,12 +97,202 @@ $  usage of the function and type of the parameters
 
 #include "elmer/matc.h"
 
+/*
+ *  Hashed index of the named lists. The lists themselves are kept as 
+ *  they are, so the order of the items (as listed by who and help) does
+ *  not change, the index only speeds up lst_find().
+ *
+ *  The list of VARIABLES is swapped to a local list while a user 
+ *  function is executed, and its start is restored after an error, 
+ *  without going through these routines. An index is thus valid only 
+ *  for the list starting from the item it was built for: when the list
+ *  header doesn't point there the index is neither used nor updated. 
+ *  Such a list is searched directly if it is short, else it is indexed
+ *  anew.
+ */
+#define LST_SHORT 8                             /* searched directly     */
+#define LST_DELETED ((LIST *)&lst_deleted)      /* removed from the index */
+
+typedef struct lst_index
+{
+  LIST *head;                 /* first item of the indexed list       */
+  LIST **table;               /* open addressing with linear probing  */
+  int size,                   /* size of the table, a power of two    */
+      used,                   /* items and removed slots in the table */
+      dups;                   /* list has items of the same name      */
+  long lookups,               /* lst_find() calls                     */
+       hashed,                /* of which through the index           */
+       probes,                /* slots looked at in those             */
+       rebuilds;              /* times the index was built            */
+} LST_INDEX;
+
+static LST_INDEX lst_index[MAX_HEADERS];
+#pragma omp threadprivate(lst_index)
+
+static LIST lst_deleted;
+
+/*
+ *  The items of a list from the one given to lst_share() on are shared 
+ *  by the lists of all the threads and interpreter contexts (the builtin
+ *  commands and constants, see mtc_init()), and are never changed: the
+ *  items added later go in front of them.
+ */
+static LIST *lst_shared[MAX_HEADERS];
+
+static unsigned int lst_hash( char *name )
+{
+  unsigned int h = 2166136261u;
+
+  while( *name ) h = (h ^ (unsigned char)*name++) * 16777619u;
+
+  return h;
+}
+
+static int lst_valid( int list )
+{
+  return list != ALLOCATIONS && lst_index[list].table != NULL && 
+          lst_index[list].head == listheaders[list].next;
+}
+
+static void lst_insert( LST_INDEX *idx, LIST *item, int replace );
+
+static int lst_resize( LST_INDEX *idx, int size )
+{
+  LIST **old = idx->table;
+  int i, oldsize = idx->size;
+
+  idx->table = (LIST **)calloc( size, sizeof(LIST *) );
+  if ( idx->table == NULL )
+  {
+    idx->table = old;
+    return FALSE;
+  }
+  idx->size = size;
+  idx->used = 0;
+
+  for( i = 0; i < oldsize; i++ )
+    if ( old[i] && old[i] != LST_DELETED ) lst_insert( idx, old[i], FALSE );
+  free( old );
+
+  return TRUE;
+}
+
+static void lst_insert( LST_INDEX *idx, LIST *item, int replace )
+/*======================================================================
+?  Add item to the index. If an item of the same name is already there
+|  the new one replaces it if replace is set, else it is left out. The
+|  index thus gives the item met first in the list.
+^=====================================================================*/
+{
+  LIST *lst;
+  unsigned int i, mask;
+  int del = -1;
+
+  if ( NAME(item) == NULL ) return;
+
+  if ( 2*(idx->used+1) > idx->size && !lst_resize( idx, 2*idx->size ) )
+  {
+    /* out of memory, drop the index */
+    free( idx->table );
+    idx->table = NULL;
+    idx->size = 0;
+    return;
+  }
+
+  mask = idx->size - 1;
+  for( i = lst_hash( NAME(item) ) & mask; (lst = idx->table[i]) != NULL; i = (i+1) & mask )
+  {
+    if ( lst == LST_DELETED )
+    {
+      if ( del < 0 ) del = i;
+    }
+    else if ( strcmp( NAME(lst), NAME(item) ) == 0 )
+    {
+      idx->dups = TRUE;
+      if ( replace ) idx->table[i] = item;
+      return;
+    }
+  }
+
+  if ( del >= 0 )
+    idx->table[del] = item;
+  else
+  {
+    idx->table[i] = item;
+    idx->used++;
+  }
+}
+
+static void lst_remove( int list, LIST *item )
+/*======================================================================
+?  Remove item, already unlinked from the list, from the index. If the
+|  list has another item of the same name it takes the place.
+^=====================================================================*/
+{
+  LST_INDEX *idx = &lst_index[list];
+  LIST *lst;
+  unsigned int i, mask = idx->size - 1;
+
+  if ( NAME(item) )
+  {
+    for( i = lst_hash( NAME(item) ) & mask; (lst = idx->table[i]) != NULL; i = (i+1) & mask )
+      if ( lst == item ) break;
+  }
+  else
+    lst = NULL;
+
+  /* renamed after it was added, look for it the hard way */
+  if ( lst == NULL )
+  {
+    for( i = 0; i < idx->size; i++ )
+      if ( idx->table[i] == item ) break;
+    if ( i >= idx->size ) return;
+  }
+
+  idx->table[i] = LST_DELETED;
+
+  if ( idx->dups && NAME(item) )
+  {
+    for( lst = listheaders[list].next; lst; lst = NEXT(lst) )
+      if ( NAME(lst) && strcmp( NAME(lst), NAME(item) ) == 0 )
+      {
+        lst_insert( idx, lst, FALSE );
+        break;
+      }
+  }
+}
+
+static void lst_reindex( int list )
+/*======================================================================
+?  Build the index for the current list.
+^=====================================================================*/
+{
+  LST_INDEX *idx = &lst_index[list];
+  LIST *lst;
+  int n = 0, size = 16;
+
+  for( lst = listheaders[list].next; lst; lst = NEXT(lst) ) n++;
+  while( size < 2*n+2 ) size *= 2;
+
+  free( idx->table );
+  idx->table = (LIST **)calloc( size, sizeof(LIST *) );
+  idx->size  = idx->table ? size : 0;
+  idx->used  = 0;
+  idx->dups  = FALSE;
+  idx->head  = listheaders[list].next;
+  idx->rebuilds++;
+
+  for( lst = idx->head; lst && idx->table; lst = NEXT(lst) ) 
+    lst_insert( idx, lst, FALSE );
+}
+
 void lst_addtail(list, item) int list; LIST *item;
 /*======================================================================
 ?  Add specified item to end of a list given.
 ^=====================================================================*/
 {
    LIST *lst;
+   int valid = lst_valid(list);
 
   /*
    *   check if the list exists, if not just make this item first in list
@@ -122,6 +312,12 @@ void lst_addtail(list, item) int list; LIST *item;
       */
      NEXT(lst) = item;
    }
+
+   if ( valid )
+   {
+     lst_index[list].head = listheaders[list].next;
+     lst_insert( &lst_index[list], item, FALSE );
+   }
 }
 
 void lst_addhead(list, item) int list; LIST *item;
@@ -129,11 +325,19 @@ void lst_addhead(list, item) int list; LIST *item;
 ?  add specified item to start of list given.
 ^=====================================================================*/
 {
+  int valid = lst_valid(list);
+
   /*
    *  make the link.
    */
    NEXT(item) = listheaders[list].next;
    listheaders[list].next = item;
+
+   if ( valid )
+   {
+     lst_index[list].head = item;
+     lst_insert( &lst_index[list], item, TRUE );
+   }
 }
 
 void lst_add(list, item) int list; LIST *item;
@@ -144,11 +348,12 @@ void lst_add(list, item) int list; LIST *item;
 ^=====================================================================*/
 {
    LIST *lst, *lstn;
+   int valid = lst_valid(list);
    
    /* 
     *  if the list is empty make this item first and return.
     */
-   if ((lst = listheaders[list].next) == (LIST *)NULL)
+   if ((lst = listheaders[list].next) == (LIST *)NULL || lst == lst_shared[list])
    {
      lst_addhead(list, item); return;
    }
@@ -163,11 +368,13 @@ void lst_add(list, item) int list; LIST *item;
      lst_addhead(list, item); return;
    }
  
+   if ( valid ) lst_insert( &lst_index[list], item, FALSE );
+
    /*
-    *  look for right place to add.
+    *  look for right place to add, in front of the shared items.
     */
    for(; NEXT(lst); lst = NEXT(lst)) 
-     if (strcmp(NAME(NEXT(lst)), NAME(item)) > 0)
+     if (NEXT(lst) == lst_shared[list] || strcmp(NAME(NEXT(lst)), NAME(item)) > 0)
      {
        lstn = NEXT(lst); 
        NEXT(lst) = item; 
@@ -187,6 +394,7 @@ void lst_unlink(list, item) int list; LIST *item;
 ^=====================================================================*/
 {
   LIST *lst;
+  int valid = lst_valid(list);
 
   /*
    *  if the list is empty return
@@ -220,6 +428,12 @@ void lst_unlink(list, item) int list; LIST *item;
    */
   else
     listheaders[list].next = NEXT(item);
+
+  if ( valid )
+  {
+    lst_index[list].head = listheaders[list].next;
+    lst_remove( list, item );
+  }
 }
 
 void lst_free(list, item) int list; LIST *item;
@@ -242,17 +456,46 @@ LIST *lst_find(list, name) int list; char *name;
 &  strcmp()
 ^=====================================================================*/
 {
+  LST_INDEX *idx = &lst_index[list];
   LIST *lst;
+  unsigned int i, mask;
+  int n;
+
+  idx->lookups++;
+
+  if ( list == ALLOCATIONS || !lst_valid(list) )
+  {
+    /*
+     *   look for item from a short list
+     */
+    for( n = 0, lst = listheaders[list].next; lst && n < LST_SHORT; lst = NEXT(lst), n++ )
+    {
+        if ( NAME(lst) && strcmp(name, NAME(lst)) == 0 ) return lst;
+    }
+    if ( lst == NULL || list == ALLOCATIONS ) return NULL;
+
+    lst_reindex( list );
+    if ( idx->table == NULL )
+    {
+      for( lst = listheaders[list].next; lst; lst = NEXT(lst) )
+        if ( NAME(lst) && strcmp(name, NAME(lst)) == 0 ) break;
+      return lst;
+    }
+  }
 
   /*
-   *   look for item
+   *   look for item from the index
    */
-  for( lst = listheaders[list].next; lst; lst = NEXT(lst) )
+  idx->hashed++;
+  mask = idx->size - 1;
+  for( i = lst_hash( name ) & mask; (lst = idx->table[i]) != NULL; i = (i+1) & mask )
   {
-      if ( NAME(lst) && strcmp(name, NAME(lst)) == 0 ) break;
+      idx->probes++;
+      if ( lst != LST_DELETED && strcmp(name, NAME(lst)) == 0 ) return lst;
   }
+  idx->probes++;
 
-  return lst;
+  return NULL;
 }
 
 void lst_purge(list) int list;
@@ -265,9 +508,19 @@ void lst_purge(list) int list;
   LIST *lst, *lstn;
 
   /*
-   *  free memory allocated for this list
+   *  drop the index of this list
+   */
+  if ( lst_valid(list) )
+  {
+    free( lst_index[list].table );
+    lst_index[list].table = NULL;
+    lst_index[list].size = 0;
+  }
+
+  /*
+   *  free memory allocated for this list, leaving the shared items
    */
-  for(lst = listheaders[list].next; lst;)
+  for(lst = listheaders[list].next; lst && lst != lst_shared[list];)
   {
     lstn = NEXT(lst);
     FREEMEM(NAME(lst));
@@ -275,7 +528,80 @@ void lst_purge(list) int list;
     lst = lstn;
   }
 
-  listheaders[list].next = (LIST *)NULL;  /* security */
+  listheaders[list].next = lst_shared[list];  /* security */
+}
+
+void lst_share(list) int list;
+/*======================================================================
+?  Share the items currently in the list with all the threads and
+|  interpreter contexts, see above.
+^=====================================================================*/
+{
+  lst_shared[list] = listheaders[list].next;
+}
+
+void *lst_index_swap( void *index )
+/*======================================================================
+?  Exchange the index of the lists for the one given (saved earlier by
+|  this routine, or NULL for an empty index). This is done when the 
+|  interpreter context is changed, see mtc_context_set().
+|
+=  the previous index of the lists, NULL if out of memory
+^=====================================================================*/
+{
+  LST_INDEX *save;
+
+  save = (LST_INDEX *)malloc( sizeof(lst_index) );
+  if ( save == NULL ) return NULL;
+
+  memcpy( save, lst_index, sizeof(lst_index) );
+  if ( index )
+  {
+    memcpy( lst_index, index, sizeof(lst_index) );
+    free( index );
+  }
+  else
+    memset( lst_index, 0, sizeof(lst_index) );
+
+  return save;
+}
+
+void lst_index_free( void *index )
+/*======================================================================
+?  Free an index saved by lst_index_swap().
+^=====================================================================*/
+{
+  LST_INDEX *idx = (LST_INDEX *)index;
+  int list;
+
+  if ( idx == NULL ) return;
+
+  for( list = 0; list < MAX_HEADERS; list++ ) free( idx[list].table );
+  free( idx );
+}
+
+VARIABLE *lst_stat( VARIABLE *ptr )
+/*======================================================================
+?  Print statistics of the lookups from the named lists.
+^=====================================================================*/
+{
+  LST_INDEX *idx;
+  LIST *lst;
+  int list, n;
+
+  PrintOut( "%-30s %8s %8s %12s %12s %8s %8s\n", "list", "items", "slots", 
+              "lookups", "hashed", "probes", "rebuilds" );
+
+  for( list = CONSTANTS; list < MAX_HEADERS; list++ )
+  {
+    idx = &lst_index[list];
+    for( n = 0, lst = listheaders[list].next; lst; lst = NEXT(lst) ) n++;
+    PrintOut( "%-30s %8d %8d %12ld %12ld %8.2f %8ld\n", listheaders[list].name, n, 
+      lst_valid(list) ? idx->size : 0, idx->lookups, idx->hashed,
+      idx->hashed > 0 ? (double)idx->probes / idx->hashed : 0.0, idx->rebuilds );
+  }
+
+  return (VARIABLE *)NULL;
 }
 
 VARIABLE *lst_print(list) int list;
@@ -143,13 +143,21 @@ VARIABLE *mtr_det(var)
   return res;
 }
 
+/*
+ * Rows handled together when forming INV(U)*INV(L) and when applying the
+ * eliminations of a panel of pivot rows in LUDecomp. Loops with less work
+ * than LU_PARALLEL multiply-adds are run on one thread.
+ */
+#define LU_BLOCK     16
+#define LU_PARALLEL  100000
+
 VARIABLE *mtr_inv(var)
      VARIABLE *var;
 {
   VARIABLE *ptr;
 
-  int i, j , k, n, *pivot;
-  double s, *a;
+  int i, j , k, n, *pivot, ib, imax, jj, jmax;
+  double s, *a, *w, *x, aik, *ak, *wi;
   
   if (NCOL(var) != NROW(var))
   {        
@@ -173,47 +181,78 @@ VARIABLE *mtr_inv(var)
     A(i,i) = 1.0 / A(i,i);
   }
 
+  /*
+   * Workspace: a full matrix for the product below, its first row doubles
+   * as the row buffer of INV(U) and x holds a column of L.
+   */
+  w = (double *)ALLOCMEM(n * n * sizeof(double));
+  x = (double *)ALLOCMEM(n * sizeof(double));
+
   /*  
-   *  INV(U)
+   *  INV(U), row i from the already inverted rows below it. The terms
+   *  are accumulated row by row, in the same order as the dot products
+   *  A(i,j) = -sum(A(i,k)*A(k,j)), k=i+1..j (unit diagonal).
    */
   for(i = n - 2; i >= 0; i--)
-    for(j = n - 1; j > i; j--)
+  {
+#pragma omp parallel for private(jmax,j,k,aik,ak) \
+        if ((double)(n-i)*(n-i) > LU_PARALLEL)
+    for(jj = i + 1; jj < n; jj += 256)
     {
-      s = 0.0;
-      for(k = i+1; k <= j; k++)
-	if (k != j)  
-	  s = s - A(i,k) * A(k,j);
-	else 
-	  s = s - A(i,k);
-      A(i,j) = s;
+      jmax = min(jj + 256, n);
+      for(j = jj; j < jmax; j++) w[j] = 0.0;
+      for(k = i + 1; k < jmax; k++)
+      {
+        aik = A(i,k); ak = &A(k,0);
+        if (k >= jj) w[k] = w[k] - aik;
+        for(j = max(k + 1, jj); j < jmax; j++) w[j] = w[j] - aik * ak[j];
+      }
     }
+    for(j = i + 1; j < n; j++) A(i,j) = w[j];
+  }
 
   /*
-   * INV(L)
+   * INV(L), column i from the already inverted columns right of it.
    */
   for(i = n - 2; i >= 0; i--)
-    for(j = n - 1; j > i; j--)
+  {
+    for(k = i + 1; k < n; k++) x[k] = A(k,i);
+#pragma omp parallel for private(s,k,ak) if ((double)(n-i)*(n-i) > LU_PARALLEL)
+    for(j = i + 1; j < n; j++)
     {
-      s = 0.0;
+      s = 0.0; ak = &A(j,0);
       for(k = i + 1; k <= j; k++) 
-	s = s - A(j,k) * A(k,i);
+	s = s - ak[k] * x[k];
       A(j,i) = A(i,i) * s;
     }
+  }
   
   /* 
-   * A  = INV(AP)
+   * A  = INV(AP), row i of the product is sum(A(i,k)*A(k,:)), k >= i,
+   * accumulated over the rows k for a block of rows i at a time.
    */
-  for(i = 0; i < n; i++)
-    for(j = 0; j < n; j++)
+  memset(w, 0, n * n * sizeof(double));
+#pragma omp parallel for private(imax,i,j,k,s,ak,wi) if ((double)n*n*n > LU_PARALLEL)
+  for(ib = 0; ib < n; ib += LU_BLOCK)
+  {
+    imax = min(ib + LU_BLOCK, n);
+    for(k = ib; k < n; k++)
     {
-      s = 0.0;
-      for(k = max(i,j); k < n; k++)
-	if (k != i)
-	  s += A(i,k) * A(k,j);
-	else 
-	  s += A(k,j);
-      A(i,j) = s;
+      ak = &A(k,0);
+      for(i = ib; i < imax && i <= k; i++)
+      {
+        wi = &w[(size_t)n * i];
+        if (k != i)
+        {
+          s = A(i,k);
+          for(j = 0; j <= k; j++) wi[j] += s * ak[j];
+        }
+        else
+          for(j = 0; j <= k; j++) wi[j] += ak[j];
+      }
     }
+  }
+  memcpy(a, w, n * n * sizeof(double));
 
   /*
    * A = INV(A) (at last)
@@ -227,6 +266,7 @@ VARIABLE *mtr_inv(var)
 	A(pivot[i],j) = s;
       }
   
+  FREEMEM((char *)x); FREEMEM((char *)w);
   FREEMEM((char *)pivot);
 
   return ptr;
@@ -240,47 +280,76 @@ VARIABLE *mtr_inv(var)
  *
  * Result is stored in place of original matrix.
  *
+ * The eliminations are done for a panel of LU_BLOCK pivot rows at a time:
+ * the rows within the panel are reduced one step after the other, and each
+ * row below the panel then gets all the panel steps in one go while it is
+ * in cache. Every element still sees the steps in the original order.
+ *
  */
 void LUDecomp(a, n, pivot)
    double *a;
    int n, pivot[];
 {
-  double swap;
-  int i, j, k, l;
+  double swap, f, *ai, *ak;
+  int i, j, k, l, ib, iend;
   
-  for (i = 0; i < n - 1; i++)
+  for (ib = 0; ib < n - 1; ib += LU_BLOCK)
   {
-    j = i;
-    for(k = i + 1; k < n; k++)
-      if (abs(A(i,k)) > abs(A(j,k))) j = k;
-    
-    if (A(i,j) == 0.0) 
+    iend = min(ib + LU_BLOCK, n - 1);
+
+    for (i = ib; i < iend; i++)
     {
-      error("LUDecomp: Matrix is singular.\n");
-    }
+      j = i;
+      for(k = i + 1; k < n; k++)
+        if (abs(A(i,k)) > abs(A(j,k))) j = k;
     
-    pivot[i] = j;
+      if (A(i,j) == 0.0) 
+      {
+        error("LUDecomp: Matrix is singular.\n");
+      }
     
-    if (j != i)
-    {
-      swap = A(i,i);
-      A(i,i) = A(i,j);
-      A(i,j) = swap;
-    }
+      pivot[i] = j;
     
-    for(k = i + 1; k < n; k++)
-      A(i,k) = A(i,k) / A(i,i);
+      if (j != i)
+      {
+        swap = A(i,i);
+        A(i,i) = A(i,j);
+        A(i,j) = swap;
+      }
     
-    for(k = i + 1; k < n; k++) 
+      for(k = i + 1; k < n; k++)
+        A(i,k) = A(i,k) / A(i,i);
+
+      ai = &A(i,0);
+      for(k = i + 1; k < iend; k++) 
+      {
+        ak = &A(k,0);
+        if (j != i)
+        {
+          swap = ak[i]; ak[i] = ak[j]; ak[j] = swap;
+        }
+        f = ak[i];
+        for(l = i + 1; l < n; l++)
+          ak[l] = ak[l] - ai[l] * f;
+      }
+    }
+
+#pragma omp parallel for private(ak,ai,i,j,l,f,swap) \
+        if ((double)(n-iend)*(n-ib)*(iend-ib) > LU_PARALLEL)
+    for(k = iend; k < n; k++) 
     {
-      if (j != i)
+      ak = &A(k,0);
+      for(i = ib; i < iend; i++)
       {
-	swap = A(k,i);
-	A(k,i) = A(k,j); 
-	A(k,j) = swap;
+        ai = &A(i,0); j = pivot[i];
+        if (j != i)
+        {
+          swap = ak[i]; ak[i] = ak[j]; ak[j] = swap;
+        }
+        f = ak[i];
+        for(l = i + 1; l < n; l++)
+          ak[l] = ak[l] - ai[l] * f;
       }
-      for(l = i + 1; l < n; l++)
-	A(k,l) = A(k,l) -  A(i,l) * A(k,i);
     }
   }
   
@@ -23,9 +23,16 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <signal.h>
+#include <time.h>
 #include "../config.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #ifdef USE_READLINE
 # ifdef HAVE_READLINE_READLINE_H
 #  include <readline/readline.h>
@@ -40,6 +47,168 @@
 
 /* prototype */
 char *mtc_domath(char *);
+int mtc_compile(char *);
+char *mtc_evaluate(int);
+void mtc_cache(int);
+char *mtc_dovector(char *, char *, double *, int, int, double *, int *);
+char *mtc_dovalues(char *, double *, int, int *, int *);
+void mtc_setvalues(char *, double *, int, int);
+
+typedef struct matc_context MATC_CONTEXT;
+MATC_CONTEXT *mtc_context_new(FILE *, FILE *, FILE *);
+MATC_CONTEXT *mtc_context_set(MATC_CONTEXT *);
+void mtc_context_free(MATC_CONTEXT *);
+
+static double bench_rate( int count, clock_t start )
+{
+  double t = (double)(clock() - start) / CLOCKS_PER_SEC;
+  return t > 0 ? count / t : 0;
+}
+
+/*
+ *  matc -bench "expression" [count]
+ *
+ *  Evaluations per second of an expression when it is parsed each time,
+ *  when the parsed command comes from the cache of mtc_domath(), when it
+ *  is compiled once with mtc_compile() and when it is evaluated for count
+ *  values of tx at once with mtc_dovector(). For the others tx is 0.5.
+ *  The statistics of name lookups (lststat) are printed last.
+ */
+static int bench( char *expr, int count )
+{
+  clock_t start;
+  char *str;
+  double *input, *values;
+  int i, handle, vector;
+
+  mtc_domath( "tx=0.5" );
+  str = mtc_domath( expr );
+  if ( str && strncmp( str, "MATC ERROR:", 11 ) == 0 )
+  {
+    fprintf( stderr, "%s", str );
+    return 1;
+  }
+  fprintf( stdout, "%s = %s", expr, str ? str : "\n" );
+
+  mtc_cache( 0 );
+  start = clock();
+  for( i = 0; i < count; i++ ) mtc_domath( expr );
+  fprintf( stdout, "parsed each time : %12.0f evaluations/s\n", bench_rate( count, start ) );
+
+  mtc_cache( 1 );
+  start = clock();
+  for( i = 0; i < count; i++ ) mtc_domath( expr );
+  fprintf( stdout, "cached           : %12.0f evaluations/s\n", bench_rate( count, start ) );
+
+  handle = mtc_compile( expr );
+  start = clock();
+  for( i = 0; i < count; i++ ) mtc_evaluate( handle );
+  fprintf( stdout, "compiled         : %12.0f evaluations/s\n", bench_rate( count, start ) );
+
+  input  = (double *)malloc( count*sizeof(double) );
+  values = (double *)malloc( count*sizeof(double) );
+  if ( !input || !values ) return 1;
+  for( i = 0; i < count; i++ ) input[i] = (double)i / count;
+
+  start = clock();
+  mtc_dovector( expr, "tx", input, 1, count, values, &vector );
+  fprintf( stdout, "vector           : %12.0f evaluations/s (%s)\n", bench_rate( count, start ),
+              vector ? "elementwise" : "point by point" );
+
+  free( input );
+  free( values );
+
+  fprintf( stdout, "%s", mtc_domath( "lststat" ) );
+
+  return 0;
+}
+
+static double wall_time( void )
+{
+#ifdef _OPENMP
+  return omp_get_wtime();
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static int context_value( char *expr, double x, double *value )
+{
+  char *str;
+  int nrow, ncol;
+
+  mtc_setvalues( "tx", &x, 1, 1 );
+  str = mtc_dovalues( expr, value, 1, &nrow, &ncol );
+
+  return ( !str || !*str ) && nrow*ncol == 1;
+}
+
+/*
+ *  matc -threads "expression" [count]
+ *
+ *  Evaluate an expression for count values of tx on all the threads at
+ *  once, each thread alternating between two interpreter contexts of 
+ *  its own, which are told apart by a variable "context". The results
+ *  are compared to those of the initial context of the main thread,
+ *  the number of differences is printed and returned as exit status.
+ */
+static int threads( char *expr, int count )
+{
+  double *ref, start, t;
+  int i, errors = 0, nthreads = 1;
+
+  ref = (double *)malloc( count*sizeof(double) );
+  if ( !ref ) return 1;
+
+  for( i = 0; i < count; i++ )
+    if ( !context_value( expr, (double)i / count, &ref[i] ) )
+    {
+      fprintf( stderr, "%s: %s", expr, mtc_domath( expr ) );
+      return 1;
+    }
+
+#ifdef _OPENMP
+  nthreads = omp_get_num_procs() > 1 ? omp_get_num_procs() : 4;
+  omp_set_num_threads( nthreads );
+#endif
+
+  start = wall_time();
+
+#pragma omp parallel private(i) reduction(+:errors)
+  {
+    MATC_CONTEXT *ctx[2], *prev;
+    double value, id;
+    int c;
+
+    for( c = 0; c < 2; c++ )
+    {
+      ctx[c] = mtc_context_new( NULL, stdout, stderr );
+      prev = mtc_context_set( ctx[c] );
+      id = c;
+      mtc_setvalues( "context", &id, 1, 1 );
+      mtc_context_set( prev );
+    }
+
+#pragma omp for schedule(dynamic,64)
+    for( i = 0; i < count; i++ )
+    {
+      c = i % 2;
+      mtc_context_set( ctx[c] );
+      if ( !context_value( expr, (double)i / count, &value ) || value != ref[i] ) errors++;
+      if ( !context_value( "context", 0.0, &value ) || value != c ) errors++;
+    }
+
+    mtc_context_set( prev );
+    for( c = 0; c < 2; c++ ) mtc_context_free( ctx[c] );
+  }
+
+  t = wall_time() - start;
+  fprintf( stdout, "%d threads: %d evaluations in %.3f s, %d differences\n", 
+             nthreads, count, t, errors );
+  free( ref );
+
+  return errors != 0;
+}
 
 int main( int argc, char **argv )
 {
@@ -54,6 +223,12 @@ int main( int argc, char **argv )
   (void)mtc_init( stdin, stdout, stderr );
   str = mtc_domath( "source(\"mc.ini\")" );
 
+  if ( argc > 2 && strcmp( argv[1], "-bench" ) == 0 )
+    return bench( argv[2], argc > 3 ? atoi( argv[3] ) : 100000 );
+
+  if ( argc > 2 && strcmp( argv[1], "-threads" ) == 0 )
+    return threads( argv[2], argc > 3 ? atoi( argv[3] ) : 100000 );
+
   signal( SIGINT, SIG_IGN );
 
   while( 1 )
@@ -104,6 +104,40 @@ $  usage of the function and type of the parameters
       static int tot;
 #pragma omp threadprivate (fplog, tot)
 #endif
+/*
+ *  the shared builtin commands and constants, see mtc_init()
+ */
+static LIST *mtc_commands = NULL, *mtc_constants = NULL;
+static int mtc_builtins_done = FALSE;
+
+static char *mtc_listnames[MAX_HEADERS] =
+{
+  "Allocations",                        /* memory allocations       */
+  "Constants",                          /* global CONSTANTS         */
+  "Currently defined VARIABLES",        /* global VARIABLES         */
+  "Builtin Functions",                  /* internal commands        */
+  "User Functions"                      /* user defined functions   */
+};
+
+static void mtc_lists( void )
+/*======================================================================
+?  Allocate the list headers of the calling thread if not done yet.
+^=====================================================================*/
+{
+#ifdef _OPENMP
+  int i;
+
+  if ( listheaders ) return;
+
+  listheaders = (LIST *)malloc( sizeof(LIST)*MAX_HEADERS );
+  for( i = 0; i < MAX_HEADERS; i++ )
+  {
+    listheaders[i].next = (LIST *)NULL;
+    listheaders[i].name = mtc_listnames[i];
+  }
+#endif /* _OPENMP */
+}
+
 /*======================================================================
 ? main program, initialize few constants and go for it.
 ^=====================================================================*/
@@ -134,29 +168,15 @@ void mtc_init( FILE *input_file, FILE *output_file, FILE *error_file )
        "Second form gives help on specific routine.\n"
    };
 
-#ifdef _OPENMP
-   /* Allocate listheaders for each thread separately */
-#pragma omp parallel
+   static char *lststatHelp =
    {
-	   /* Do malloc and initialize listheaders */
-	   listheaders = (LIST *) malloc(sizeof(LIST)*MAX_HEADERS);
-	   /* memory allocations */
-	   listheaders[ALLOCATIONS].next = NULL;
-	   listheaders[ALLOCATIONS].name = "Allocations";
-	   /* global CONSTANTS */
-	   listheaders[CONSTANTS].next = NULL;
-	   listheaders[CONSTANTS].name = "Constants";
-	   /* global VARIABLES */
-	   listheaders[VARIABLES].next = NULL;
-	   listheaders[VARIABLES].name = "Currently defined VARIABLES";
-	   /* internal commands */
-	   listheaders[COMMANDS].next = NULL;
-	   listheaders[COMMANDS].name = "Builtin Functions";
-	   /* user defined functions */
-	   listheaders[FUNCTIONS].next = NULL;
-	   listheaders[FUNCTIONS].name = "User Functions";
-   }
-#endif /* _OPENMP */
+       "lststat\n\n"
+       "Print the number of lookups of names from the lists of constants,\n"
+       "variables and functions, and the average probe length of those\n"
+       "made through the hashed index of the list.\n"
+   };
+
+  mtc_lists();
 
 #ifdef DEBUG
       fplog = fopen("matcdbg","w");
@@ -170,42 +190,68 @@ void mtc_init( FILE *input_file, FILE *output_file, FILE *error_file )
   math_err = error_file;
   math_out = output_file;
 
-  mtr_com_init();          /* initialize matrix handling commands   */
-  var_com_init();          /*     ""     VARIABLE  ""      ""       */
-  fnc_com_init();          /*     ""     function handling commands */
-  fil_com_init();          /*     ""     file handling commands     */
-  gra_com_init();          /*     ""     graphics commands          */
-  str_com_init();          /*     ""     string handling            */
+  fil_init();
 
   /*
-   *    and few others.
+   *   The builtin commands and constants are made by the first caller,
+   *   and shared read only by all the threads and contexts after that.
    */
-  com_init( "eval"   , FALSE, FALSE, com_apply,   1, 1, evalHelp   );
-  com_init( "source" , FALSE, FALSE, com_source,  1, 1, sourceHelp );
-  com_init( "help"   , FALSE, FALSE, com_help   , 0, 1, helpHelp   );
-  com_init( "quit"   , FALSE, FALSE, com_quit   , 0, 0, "quit\n" );
-  com_init( "exit"   , FALSE, FALSE, com_quit   , 0, 0, "exit\n" );
+#pragma omp critical (mtc_builtins)
+  {
+    if ( !mtc_builtins_done )
+    {
+      listheaders[COMMANDS].next  = (LIST *)NULL;
+      listheaders[CONSTANTS].next = (LIST *)NULL;
+
+      mtr_com_init();          /* initialize matrix handling commands   */
+      var_com_init();          /*     ""     VARIABLE  ""      ""       */
+      fnc_com_init();          /*     ""     function handling commands */
+      fil_com_init();          /*     ""     file handling commands     */
+      gra_com_init();          /*     ""     graphics commands          */
+      str_com_init();          /*     ""     string handling            */
+
+      /*
+       *    and few others.
+       */
+      com_init( "eval"   , FALSE, FALSE, com_apply,   1, 1, evalHelp   );
+      com_init( "source" , FALSE, FALSE, com_source,  1, 1, sourceHelp );
+      com_init( "help"   , FALSE, FALSE, com_help   , 0, 1, helpHelp   );
+      com_init( "lststat", FALSE, FALSE, lst_stat   , 0, 0, lststatHelp );
+      com_init( "quit"   , FALSE, FALSE, com_quit   , 0, 0, "quit\n" );
+      com_init( "exit"   , FALSE, FALSE, com_quit   , 0, 0, "exit\n" );
   
-  /*
-   *    these constants will always be there for you.
-   */
-  ptr = const_new("true", TYPE_DOUBLE, 1, 1);
-  M(ptr,0,0) = 1.0;
+      /*
+       *    these constants will always be there for you.
+       */
+      ptr = const_new("true", TYPE_DOUBLE, 1, 1);
+      M(ptr,0,0) = 1.0;
+
+      ptr = const_new("false", TYPE_DOUBLE, 1, 1);
+      M(ptr,0,0) = 0.0;
 
-  ptr = const_new("false", TYPE_DOUBLE, 1, 1);
-  M(ptr,0,0) = 0.0;
+      ptr = const_new("stdin", TYPE_DOUBLE, 1, 1);
+      M(ptr,0,0) = 0;
 
-  ptr = const_new("stdin", TYPE_DOUBLE, 1, 1);
-  M(ptr,0,0) = 0;
+      ptr = const_new("stdout", TYPE_DOUBLE, 1, 1);
+      M(ptr,0,0) = 1;
 
-  ptr = const_new("stdout", TYPE_DOUBLE, 1, 1);
-  M(ptr,0,0) = 1;
+      ptr = const_new("stderr", TYPE_DOUBLE, 1, 1);
+      M(ptr,0,0) = 2;
 
-  ptr = const_new("stderr", TYPE_DOUBLE, 1, 1);
-  M(ptr,0,0) = 2;
+      ptr = const_new("pi", TYPE_DOUBLE, 1, 1);
+      M(ptr,0,0) = 2*acos(0.0);
 
-  ptr = const_new("pi", TYPE_DOUBLE, 1, 1);
-  M(ptr,0,0) = 2*acos(0.0);
+      lst_share( COMMANDS );
+      lst_share( CONSTANTS );
+      mtc_commands  = listheaders[COMMANDS].next;
+      mtc_constants = listheaders[CONSTANTS].next;
+
+      ALLOC_HEAD = (LIST *)NULL;
+      mtc_builtins_done = TRUE;
+    }
+  }
+  listheaders[COMMANDS].next  = mtc_commands;
+  listheaders[CONSTANTS].next = mtc_constants;
 
 #if 0
   /*
@@ -243,20 +289,320 @@ void mtc_init( FILE *input_file, FILE *output_file, FILE *error_file )
   return;   /* done */
 }
 
-char * mtc_domath( char *str )
+/*
+ *  Parsed commands are kept in a per thread cache keyed by the command
+ *  text, so that expressions the solver evaluates over and over again
+ *  (once per node or integration point) are tokenized and parsed only
+ *  once. A command is stored the second time it is met, commands used
+ *  only once (eg. assignments of changing values) don't displace the
+ *  useful entries. Function definitions are never stored, evaluating
+ *  them hands the body over to the function.
+ */
+#define CACHE_SIZE 512
+
+typedef struct cache_entry
 {
-  VARIABLE *headsave;            /* this should not be here */
+  unsigned int hash,      /* hash of the stored command            */
+               seen;      /* hash of the last command not stored   */
+  char *text;             /* text of the stored command            */
+  CLAUSE *clause;         /* and the parsed command                */
+} CACHE_ENTRY;
 
-  jmp_buf jmp, *savejmp;         /* save program context */
+static CACHE_ENTRY *mtc_cache_table = NULL;
+static int mtc_cache_off = FALSE;
 
-  void (*sigfunc)() =  (void (*)())signal( SIGINT, sig_trap );
+/* operations lists given by mtc_compile() */
+static CLAUSE **mtc_handles = NULL;
+static int mtc_handlecount = 0, mtc_handlesize = 0;
+#pragma omp threadprivate (mtc_cache_table, mtc_cache_off, mtc_handles, mtc_handlecount, mtc_handlesize)
 
-  if ( !str || !*str )
+static unsigned int cache_hash( char *str )
+{
+  unsigned int h = 2166136261u;
+
+  while( *str ) h = (h ^ (unsigned char)*str++) * 16777619u;
+
+  return h;
+}
+
+static int cache_allowed( CLAUSE *root )
+{
+  for( ; root; root = LINK(root) )
+    if ( root->data == funcsym ) return FALSE;
+
+  return TRUE;
+}
+
+void mtc_cache( int on )
+/*======================================================================
+?  Enable or disable the cache of parsed commands of mtc_domath().
+|  Disabling it also releases the stored commands.
+^=====================================================================*/
+{
+  int i;
+
+  if ( !on && mtc_cache_table )
   {
-      str = (char *)doread();
-      signal( SIGINT, sigfunc );
-      return math_out_str;
+    for( i = 0; i < CACHE_SIZE; i++ )
+    {
+      if ( mtc_cache_table[i].clause ) free_clause( mtc_cache_table[i].clause );
+      free( mtc_cache_table[i].text );
+    }
+    free( mtc_cache_table );
+    mtc_cache_table = NULL;
+  }
+  mtc_cache_off = !on;
+}
+
+static CACHE_ENTRY *cache_entry( char *str, unsigned int *hash )
+{
+  if ( mtc_cache_off ) return NULL;
+
+  if ( !mtc_cache_table )
+  {
+    mtc_cache_table = (CACHE_ENTRY *)calloc( CACHE_SIZE, sizeof(CACHE_ENTRY) );
+    if ( !mtc_cache_table ) return NULL;
+  }
+
+  *hash = cache_hash( str );
+  return &mtc_cache_table[*hash % CACHE_SIZE];
+}
+
+static int cache_match( CACHE_ENTRY *entry, char *str, unsigned int hash )
+{
+  return entry->clause && entry->hash == hash && strcmp( entry->text, str ) == 0;
+}
+
+static void cache_store( CACHE_ENTRY *entry, char *str, unsigned int hash, CLAUSE *root )
+{
+  if ( entry->clause ) free_clause( entry->clause );
+  free( entry->text );
+  entry->text = (char *)malloc( strlen(str)+1 );
+  if ( entry->text )
+  {
+    strcpy( entry->text, str );
+    entry->clause = root;
+    entry->hash = hash;
+  }
+  else
+  {
+    entry->clause = NULL;
+    free_clause( root );
+  }
+  entry->seen = 0;
+}
+
+static VARIABLE *cache_eval( char *str )
+/*======================================================================
+?  Evaluate a command, taking the parsed command from the cache if
+|  possible. If parsing or evaluation fails error() frees the new 
+|  operations list with the rest of the memory allocated, so the list
+|  is stored only after a succesful evaluation.
+^=====================================================================*/
+{
+  CACHE_ENTRY *entry;
+  CLAUSE *root;
+  VARIABLE *res;
+  unsigned int hash;
+
+  if ( (entry = cache_entry( str, &hash )) == NULL ) return doit( str );
+
+  if ( cache_match( entry, str, hash ) ) return evalclause( entry->clause );
+
+  root = parseline( str );
+  res  = evalclause( root );
+
+  if ( entry->seen == hash && cache_allowed( root ) )
+  {
+    cache_store( entry, str, hash, root );
+  }
+  else
+  {
+    entry->seen = hash;
+    free_clause( root );
+  }
+
+  return res;
+}
+
+/*
+ *  Interpreter contexts. The state of the interpreter of a thread (the
+ *  lists of variables and user functions, the output buffer, the parsed
+ *  commands...) lives in the thread private globals of the modules, a 
+ *  context keeps it while another context is in use on the thread. All
+ *  the contexts share the builtin commands and constants.
+ */
+struct matc_context
+{
+  LIST headers[MAX_HEADERS];     /* the named lists                   */
+  void *index;                   /* and their index, see lists.c      */
+  FILE *in, *out, *err;          /* streams                           */
+  char *out_str;                 /* output string                     */
+  int out_count, out_allocated;
+  int format[3];                 /* output format, see var_format()   */
+  CACHE_ENTRY *cache;            /* cache of parsed commands          */
+  int cache_off;
+  CLAUSE **handles;              /* commands given by mtc_compile()   */
+  int handlecount, handlesize;
+};
+
+/* context of the state in the globals, NULL for the initial one */
+static MATC_CONTEXT *mtc_current = NULL;
+#pragma omp threadprivate (mtc_current)
+
+static int context_swap( MATC_CONTEXT *save, MATC_CONTEXT *load )
+{
+  char *str;
+  void *index;
+  int n;
+
+  if ( (index = lst_index_swap( load->index )) == NULL ) return FALSE;
+  save->index = index;
+  load->index = NULL;
+
+  mtc_lists();
+  memcpy( save->headers, listheaders, sizeof(LIST)*MAX_HEADERS );
+  memcpy( listheaders, load->headers, sizeof(LIST)*MAX_HEADERS );
+
+  save->in  = math_in;  math_in  = load->in;
+  save->out = math_out; math_out = load->out;
+  save->err = math_err; math_err = load->err;
+
+  str = math_out_str; math_out_str = load->out_str; save->out_str = str;
+  save->out_count = math_out_count; math_out_count = load->out_count;
+  save->out_allocated = math_out_allocated; math_out_allocated = load->out_allocated;
+
+  memcpy( save->format, load->format, sizeof(load->format) );
+  var_format_swap( save->format );
+
+  save->cache = mtc_cache_table; mtc_cache_table = load->cache;
+  save->cache_off = mtc_cache_off; mtc_cache_off = load->cache_off;
+
+  save->handles = mtc_handles; mtc_handles = load->handles;
+  n = mtc_handlecount; mtc_handlecount = load->handlecount; save->handlecount = n;
+  n = mtc_handlesize;  mtc_handlesize  = load->handlesize;  save->handlesize = n;
+
+  return TRUE;
+}
+
+MATC_CONTEXT *mtc_context_new( FILE *input_file, FILE *output_file, FILE *error_file )
+/*======================================================================
+?  Make a new interpreter context, with no variables or user functions
+|  of its own. The context is taken in use by mtc_context_set(), each
+|  context may be in use on one thread at a time.
+|
+=  the new context, NULL if out of memory
+^=====================================================================*/
+{
+  MATC_CONTEXT *ctx, *prev;
+  int i;
+
+  ctx = (MATC_CONTEXT *)calloc( 1, sizeof(MATC_CONTEXT) );
+  if ( ctx == NULL ) return NULL;
+
+  for( i = 0; i < MAX_HEADERS; i++ ) ctx->headers[i].name = mtc_listnames[i];
+  ctx->format[0] = 3;
+
+  if ( (prev = mtc_context_set( ctx )) == NULL )
+  {
+    free( ctx );
+    return NULL;
   }
+  mtc_init( input_file, output_file, error_file );
+  mtc_context_set( prev );
+
+  return ctx;
+}
+
+MATC_CONTEXT *mtc_context_set( MATC_CONTEXT *ctx )
+/*======================================================================
+?  Take the given context in use on the calling thread. Not to be done
+|  while a command is being evaluated.
+|
+=  the context in use before, to be given back to this routine to 
+|  restore it, NULL if the context could not be changed
+^=====================================================================*/
+{
+  MATC_CONTEXT *prev;
+
+  if ( ctx == NULL || jmpbuf != NULL ) return NULL;
+  if ( ctx == mtc_current ) return ctx;
+
+  if ( (prev = mtc_current) == NULL )
+  {
+    prev = (MATC_CONTEXT *)calloc( 1, sizeof(MATC_CONTEXT) );
+    if ( prev == NULL ) return NULL;
+  }
+
+  if ( !context_swap( prev, ctx ) )
+  {
+    if ( prev != mtc_current ) free( prev );
+    return NULL;
+  }
+  mtc_current = ctx;
+
+  return prev;
+}
+
+void mtc_context_free( MATC_CONTEXT *ctx )
+/*======================================================================
+?  Free a context not in use, and the variables and user functions of
+|  it.
+^=====================================================================*/
+{
+  MATC_CONTEXT *prev;
+  int i;
+
+  if ( ctx == NULL || ctx == mtc_current ) return;
+  if ( (prev = mtc_context_set( ctx )) == NULL ) return;
+
+  var_free();
+  fnc_free();
+  mtc_cache( 0 );
+  for( i = 0; i < mtc_handlecount; i++ ) free_clause( mtc_handles[i] );
+  free( mtc_handles );
+  mtc_handles = NULL;
+  mtc_handlecount = mtc_handlesize = 0;
+  free( math_out_str );
+  math_out_str = NULL;
+  math_out_count = math_out_allocated = 0;
+
+  mtc_context_set( prev );
+
+  lst_index_free( ctx->index );
+  free( ctx );
+}
+
+static void copy_values( VARIABLE *res, double *values, int size, int *nrow, int *ncol )
+{
+  int n;
+
+  *nrow = *ncol = 0;
+  if ( !res ) return;
+
+  *nrow = NROW(res);
+  *ncol = NCOL(res);
+  n = min( size, NROW(res)*NCOL(res) );
+  if ( n > 0 ) memcpy( values, MATR(res), n*sizeof(double) );
+}
+
+static char *mtc_run( char *str, CLAUSE *clause, 
+              double *values, int size, int *nrow, int *ncol )
+/*======================================================================
+?  Evaluate a command given either as text or as a parsed operations
+|  list. If values is given the numeric result is copied there instead
+|  of printing it to the output string.
+^=====================================================================*/
+{
+  VARIABLE *headsave;            /* this should not be here */
+
+  VARIABLE *res;
+
+  LIST *allocsave = ALLOC_HEAD;  /* of a command calling this one */
+
+  jmp_buf jmp, *savejmp;         /* save program context */
+
+  void (*sigfunc)() =  (void (*)())signal( SIGINT, sig_trap );
 
   savejmp = jmpbuf;
   jmpbuf = &jmp;
@@ -267,10 +613,13 @@ char * mtc_domath( char *str )
   if ( math_out_str ) math_out_str[0] = '\0';
   math_out_count  = 0;
 
+  if ( values ) *nrow = *ncol = 0;
+  math_quiet = ( values != NULL );
+
   /*
    *   try it
    */
-  if (*str != '\0')
+  if ( clause || *str != '\0' )
   {
      ALLOC_HEAD = (LIST *)NULL;
      headsave = (VARIABLE *)VAR_HEAD;
@@ -283,7 +632,11 @@ char * mtc_domath( char *str )
     switch (setjmp(*jmpbuf))
     {
       case 0:
-        (void)doit( str );
+        if ( clause )
+          res = evalclause( clause );
+        else
+          res = cache_eval( str );
+        if ( values ) copy_values( res, values, size, nrow, ncol );
         longjmp(*jmpbuf, 1);
       break;
 
@@ -299,13 +652,267 @@ char * mtc_domath( char *str )
     }
   }
 
+  math_quiet = FALSE;
   jmpbuf = savejmp;
+  if ( savejmp ) ALLOC_HEAD = allocsave;
 
   signal( SIGINT, sigfunc );
 
   return math_out_str;
 }
 
+char * mtc_domath( char *str )
+{
+  void (*sigfunc)();
+
+  if ( !str || !*str )
+  {
+      sigfunc = (void (*)())signal( SIGINT, sig_trap );
+      str = (char *)doread();
+      signal( SIGINT, sigfunc );
+      return math_out_str;
+  }
+
+  return mtc_run( str, NULL, NULL, 0, NULL, NULL );
+}
+
+char *mtc_dovalues( char *str, double *values, int size, int *nrow, int *ncol )
+/*======================================================================
+?  Evaluate a command and return the numeric value of its result in
+|  the callers buffer instead of formatting it to the output string.
+|  At most size values are copied in row order, nrow and ncol are set
+|  to the dimensions of the result (zero if there is no result).
+|
+=  output string, containing error messages and explicit output only
+^=====================================================================*/
+{
+  if ( !str ) str = "";
+
+  return mtc_run( str, NULL, values, size, nrow, ncol );
+}
+
+void mtc_setvalues( char *name, double *values, int nrow, int ncol )
+/*======================================================================
+?  Set a global variable from the callers buffer (in row order) without 
+|  going through the parser. The matrix of the variable is reused if 
+|  it has the right size and is not shared.
+^=====================================================================*/
+{
+  VARIABLE *var;
+  LIST *allocsave;
+
+  allocsave = ALLOC_HEAD;
+  ALLOC_HEAD = (LIST *)NULL;
+
+  var = var_check( name );
+  if ( !var || TYPE(var) != TYPE_DOUBLE || REFCNT(var) > 1 ||
+        NROW(var) != nrow || NCOL(var) != ncol )
+  {
+    var = var_new( name, TYPE_DOUBLE, nrow, ncol );
+  }
+  memcpy( MATR(var), values, nrow*ncol*sizeof(double) );
+  var->changed = 1;
+
+  ALLOC_HEAD = allocsave;
+}
+
+static void vector_eval( char *str, char *name, double *input, int nvar, int n,
+                          double *values, int *vector )
+/*======================================================================
+?  Evaluate a command for n points, see mtc_dovector(). A single 
+|  expression made of elementwise operations is evaluated once over 
+|  all the points, anything else point by point.
+^=====================================================================*/
+{
+  CACHE_ENTRY *entry;
+  CLAUSE *root, *stmt;
+  TREE *tree = NULL;
+  VARIABLE *var, *res;
+  unsigned int hash;
+  int j, stored;
+
+  entry  = cache_entry( str, &hash );
+  stored = entry && cache_match( entry, str, hash );
+  root   = stored ? entry->clause : parseline( str );
+
+  /*
+   *  a single expression without assignment
+   */
+  stmt = LINK(root);
+  if ( stmt && stmt->data == assignsym && stmt->this == NULL && 
+       LINK(stmt) && LINK(LINK(stmt)) == NULL ) tree = LINK(stmt)->this;
+
+  if ( tree && vec_check( tree, name, nvar ) != VEC_NONE )
+  {
+    var = var_temp_new( TYPE_DOUBLE, n, nvar );
+    memcpy( MATR(var), input, n*nvar*sizeof(double) );
+
+    res = evalvector( tree, name, var );
+    if ( NROW(res)*NCOL(res) == 1 )
+      for( j = 0; j < n; j++ ) values[j] = M(res,0,0);
+    else
+      memcpy( values, MATR(res), n*sizeof(double) );
+
+    var_delete_temp( res );
+    var_delete_temp( var );
+    *vector = TRUE;
+  }
+  else
+  {
+    /* a function defined here would be released by a later error() */
+    if ( !cache_allowed( root ) ) error( "Function definition evaluated for points: [%s].\n", str );
+
+    for( j = 0; j < n; j++ )
+    {
+      mtc_setvalues( name, &input[j*nvar], 1, nvar );
+      res = evalclause( root );
+      if ( !res || NROW(res)*NCOL(res) < 1 ) error( "No value from expression: [%s].\n", str );
+      values[j] = MATR(res)[0];
+    }
+    *vector = FALSE;
+  }
+
+  if ( !stored )
+  {
+    if ( entry && cache_allowed( root ) )
+      cache_store( entry, str, hash, root );
+    else
+      free_clause( root );
+  }
+}
+
+char *mtc_dovector( char *str, char *name, double *input, int nvar, int n, 
+                         double *values, int *vector )
+/*======================================================================
+?  Evaluate an expression for n points at once. For the j:th point the
+|  variable name is set to the nvar values input[j*nvar...j*nvar+nvar-1]
+|  and the first value of the result is stored in values[j]. 
+|
+|  Expressions built of numbers, scalar variables, components of the 
+|  input variable (name(k)), pointwise builtin functions and elementwise
+|  operators are evaluated only once with each component of the input
+|  replaced by a row of its values at all points; vector is then set
+|  TRUE. Other commands are evaluated point by point from the parsed
+|  operations list.
+|
+=  output string, containing error messages and explicit output only
+^=====================================================================*/
+{
+  jmp_buf jmp, *savejmp;
+  VARIABLE *headsave;
+
+  void (*sigfunc)() =  (void (*)())signal( SIGINT, sig_trap );
+
+  savejmp = jmpbuf;
+  jmpbuf = &jmp;
+
+  if ( math_out_str ) math_out_str[0] = '\0';
+  math_out_count = 0;
+
+  *vector = FALSE;
+  math_quiet = TRUE;
+
+  if ( str && *str != '\0' && n > 0 && nvar > 0 )
+  {
+    ALLOC_HEAD = (LIST *)NULL;
+    headsave = (VARIABLE *)VAR_HEAD;
+
+    switch (setjmp(*jmpbuf))
+    {
+      case 0:
+        vector_eval( str, name, input, nvar, n, values, vector );
+        longjmp(*jmpbuf, 1);
+      break;
+
+      case 1:
+      break;
+
+      case 2:
+        VAR_HEAD = (LIST *)headsave;
+      break;
+
+      case 3:
+      break;
+    }
+  }
+
+  math_quiet = FALSE;
+  jmpbuf = savejmp;
+
+  signal( SIGINT, sigfunc );
+
+  return math_out_str;
+}
+
+int mtc_compile( char *str )
+/*======================================================================
+?  Parse a command once for repeated evaluation with mtc_evaluate().
+|  The operations list is kept for the lifetime of the calling thread.
+|
+=  handle of the parsed command, -1 if parsing failed in which case 
+|  the error message is in the output string.
+^=====================================================================*/
+{
+  jmp_buf jmp, *savejmp;
+  CLAUSE * volatile root = NULL;
+  CLAUSE **handles;
+
+  if ( !str || !*str ) return -1;
+
+  savejmp = jmpbuf;
+  jmpbuf = &jmp;
+
+  if ( math_out_str ) math_out_str[0] = '\0';
+  math_out_count  = 0;
+
+  ALLOC_HEAD = (LIST *)NULL;
+  if ( setjmp(*jmpbuf) == 0 ) root = parseline( str );
+
+  jmpbuf = savejmp;
+
+  if ( !root ) return -1;
+
+  if ( !cache_allowed( root ) )
+  {
+    free_clause( root );
+    return -1;
+  }
+
+  if ( mtc_handlecount >= mtc_handlesize )
+  {
+    handles = (CLAUSE **)realloc( mtc_handles, (2*mtc_handlesize+16)*sizeof(CLAUSE *) );
+    if ( !handles )
+    {
+      free_clause( root );
+      return -1;
+    }
+    mtc_handles = handles;
+    mtc_handlesize = 2*mtc_handlesize+16;
+  }
+  mtc_handles[mtc_handlecount] = root;
+
+  return mtc_handlecount++;
+}
+
+char *mtc_evaluate( int handle )
+/*======================================================================
+?  Evaluate a command parsed by mtc_compile(). Variables referenced by
+|  the command take their current values.
+|
+=  output string as with mtc_domath()
+^=====================================================================*/
+{
+  if ( handle < 0 || handle >= mtc_handlecount )
+  {
+    if ( math_out_str ) math_out_str[0] = '\0';
+    math_out_count = 0;
+    PrintOut( "MATC ERROR: Invalid handle of a compiled command: %d.\n", handle );
+    return math_out_str;
+  }
+
+  return mtc_run( "", mtc_handles[handle], NULL, 0, NULL, NULL );
+}
+
 char *doread()
 /*======================================================================
 ?  doread() is really the main loop of this program. Function reads
@@ -316,12 +316,62 @@ MATRIX *opr_subs(A, B)
   return C;
 }
 
+/*
+ * Blocking factors of the dense product below: a MUL_BLOCK_K x MUL_BLOCK_J
+ * panel of the right hand matrix is reused from cache for MUL_BLOCK_I rows
+ * of the left one. Products smaller than MUL_PARALLEL multiply-adds are not
+ * worth distributing over threads.
+ */
+#define MUL_BLOCK_I   32
+#define MUL_BLOCK_K  128
+#define MUL_BLOCK_J  512
+#define MUL_PARALLEL 100000
+
+/*
+ * c(n,p) += a(n,m) * b(m,p), all row major. The loops are ordered i-k-j so
+ * that the innermost loop runs over contiguous rows of b and c. Each c(i,j)
+ * still sums its terms in increasing k, so the result is identical to the
+ * plain dot product loop.
+ */
+static void mat_mul_kernel(a, b, c, n, m, p)
+     double *a, *b, *c;
+     int n, m, p;
+{
+  int ii, kk, jj, i, k, j, imax, kmax, jmax;
+  double aik, *bk, *ci;
+
+#pragma omp parallel for private(kk,jj,i,k,j,imax,kmax,jmax,aik,bk,ci) \
+        if ((double)n*m*p > MUL_PARALLEL && n > MUL_BLOCK_I)
+  for(ii = 0; ii < n; ii += MUL_BLOCK_I)
+  {
+    imax = min(ii + MUL_BLOCK_I, n);
+    for(kk = 0; kk < m; kk += MUL_BLOCK_K)
+    {
+      kmax = min(kk + MUL_BLOCK_K, m);
+      for(jj = 0; jj < p; jj += MUL_BLOCK_J)
+      {
+        jmax = min(jj + MUL_BLOCK_J, p);
+        for(i = ii; i < imax; i++)
+        {
+          ci = &c[(size_t)p * i];
+          for(k = kk; k < kmax; k++)
+          {
+            aik = a[(size_t)m * i + k];
+            bk = &b[(size_t)p * k];
+            for(j = jj; j < jmax; j++) ci[j] += aik * bk[j];
+          }
+        }
+      }
+    }
+  }
+}
+
 MATRIX *opr_mul(A, B)
      MATRIX *A, *B;
 {
   MATRIX *C;
 
-  double value,s;
+  double value;
   int i, j, k;
 
   int nrowa = NROW(A), ncola = NCOL(A);
@@ -344,17 +394,7 @@ MATRIX *opr_mul(A, B)
   else if (ncola == nrowb)
   {
     C = mat_new(TYPE(A), nrowa,ncolb); 
-    c = MATR(C);
-    for(i = 0; i < nrowa; i++)
-    {
-      for(j = 0; j < ncolb; j++)
-      {
-        s = 0;
-	for(k = 0; k < ncola; k++) s += a[k] * MB(k,j);
-	*c++ = s;
-      }
-      a += ncola;
-    }
+    mat_mul_kernel(a, b, MATR(C), nrowa, ncola, ncolb);
   }
   else if ( ncola == ncolb && nrowa == nrowb )
   {
@@ -451,7 +491,7 @@ MATRIX *opr_pow(A,B)
 {
   MATRIX *C;
 
-  int i, j, k, l, power;
+  int i, l, power;
 
   int nrowa = NROW(A), ncola = NCOL(A);
   int nrowb = NROW(B), ncolb = NCOL(B);
@@ -485,23 +525,16 @@ MATRIX *opr_pow(A,B)
   }
   else
   {
-    v = (double *)ALLOCMEM(nrowa * sizeof(double));
+    v = (double *)ALLOCMEM(nrowa * nrowa * sizeof(double));
 
     C = mat_new(TYPE(A), nrowa, nrowa);
     c = MATR(C); b = MATR(A);
 
     for(l = 1; l < abs(power); l++) {
-      for(i = 0; i < nrowa; i++)
-      {
-	for(j = 0; j < nrowa; j++)
-	{
-	  v[j] = 0.0;
-	  for(k = 0; k < nrowa; k++) v[j] +=  b[k] * MA(k,j);
-	}
-	for(j = 0; j < nrowa; j++) *c++ = v[j];
-	b += nrowa;
-      }
-      a = MATR(A); b = c = MATR(C);
+      if (l > 1) memset(v, 0, nrowa * nrowa * sizeof(double));
+      mat_mul_kernel(b, a, v, nrowa, nrowa, nrowa);
+      memcpy(c, v, nrowa * nrowa * sizeof(double));
+      b = c;
     }
     FREEMEM((char *)v);
   }
@@ -889,7 +922,7 @@ MATRIX *opr_not(A)
 
   C = mat_new(TYPE(A),nrowa,ncola); c = MATR(C);
   nrowa *= ncola;
-  for(i = 0; i < nrowa; i++,c++) if (*a == 0) *c = 1;
+  for(i = 0; i < nrowa; i++,c++) if (a[i] == 0) *c = 1;
 
   return C;
 }
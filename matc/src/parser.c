@@ -1432,11 +1432,15 @@ void free_clause(root)
     FREEMEM((char *)root);
 }
 
-VARIABLE *doit(line)
+CLAUSE *parseline(line)
 	char *line;
+/*======================================================================
+?  Parse a command line to an operations list without evaluating it.
+|  The list may be evaluated any number of times with evalclause()
+|  and is released with free_clause().
+^=====================================================================*/
 {
   CLAUSE *ptr, *root;
-  VARIABLE *res;
 
   str = buf;
   strcpy( str, line );
@@ -1456,6 +1460,16 @@ VARIABLE *doit(line)
 
 /*  root = optimclause(root); */
 /*  printclause(root, math_out, 0);   */
+  return root;
+}
+
+VARIABLE *doit(line)
+	char *line;
+{
+  CLAUSE *root;
+  VARIABLE *res;
+
+  root = parseline( line );
   res = evalclause(root);
 
   free_clause(root);
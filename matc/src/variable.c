@@ -240,6 +240,19 @@ VARIABLE *var_format(var) VARIABLE *var;
   return (VARIABLE *)NULL;
 }
 
+void var_format_swap(format) int *format;
+/*======================================================================
+?  Exchange the output format settings (precision, input form and row
+|  form, see var_format()) for the three values given.
+^=====================================================================*/
+{
+  int save;
+
+  save = var_pprec; var_pprec = format[0]; format[0] = save;
+  save = var_pinp; var_pinp = format[1]; format[1] = save;
+  save = var_rowintime; var_rowintime = format[2]; format[2] = save;
+}
+
 void var_print(ptr) VARIABLE *ptr;
 {
   double maxp, minp, maxx;
@@ -6,6 +6,9 @@
 #include <unistd.h>
 #endif
 #include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <iostream>
 
 void BGTriangleMesh::
 initialize(std::vector< GeometryNode* >& nds, std::vector< GeometryEdge* >& eds)
@@ -53,6 +56,7 @@ initialize(std::vector< GeometryNode* >& nds, std::vector< GeometryEdge* >& eds)
 			vtx->initInterpolation( );
 		}
 	}
+	makeLocator();
 	dump();		
 }
 
@@ -74,13 +78,169 @@ getVertices( std::vector< Vertex * >& v, const int count )
 	}	
 }
 
+static bool
+touchesWorld( Vertex *vtx, Node **world )
+{
+	for( int i = 0; i < 3; ++i )
+		for( int k = 0; k < 4; ++k )
+			if( vtx->nodeAt(i) == world[k] ) return true;
+	return false;
+}
+
+void BGTriangleMesh::
+makeLocator()
+{
+	std::list< Vertex* >::iterator vxIt;
+	int i, j, count = 0;
+	double minx = 0, maxx = 0, miny = 0, maxy = 0;
+	
+	// Bounding box of the real triangles, i.e. those not touching the world corners
+	for( vxIt = allVertices.begin(); vxIt != allVertices.end(); ++vxIt )
+	{
+		Vertex *vtx = *vxIt;
+		if( vtx->isDeleted() || touchesWorld( vtx, world ) ) continue;
+		for( i = 0; i < 3; ++i )
+		{
+			Node *nd = vtx->nodeAt(i);
+			if( count == 0 && i == 0 )
+			{
+				minx = maxx = nd->x;
+				miny = maxy = nd->y;
+			}
+			minx = std::min( minx, nd->x ); maxx = std::max( maxx, nd->x );
+			miny = std::min( miny, nd->y ); maxy = std::max( maxy, nd->y );
+		}
+		++count;
+	}
+	
+	delete [] cells;
+	cells = NULL;
+	last = NULL;
+	lastCell = -1;
+	if( count == 0 ) return;
+	
+	// Roughly one triangle per cell keeps the walks short
+	double width = std::max( maxx - minx, 1.0e-12 );
+	double height = std::max( maxy - miny, 1.0e-12 );
+	double side = sqrt( width * height / count );
+	nh = std::max( 1, std::min( 2048, (int)ceil( width / side ) ) );
+	nv = std::max( 1, std::min( 2048, (int)ceil( height / side ) ) );
+	ox = minx;
+	oy = miny;
+	cw = width / nh;
+	ch = height / nv;
+	
+	cells = new BGVertex*[nh * nv];
+	for( i = 0; i < nh * nv; ++i ) cells[i] = NULL;
+	
+	for( vxIt = allVertices.begin(); vxIt != allVertices.end(); ++vxIt )
+	{
+		Vertex *vtx = *vxIt;
+		if( vtx->isDeleted() || touchesWorld( vtx, world ) ) continue;
+		double cx = (vtx->nodeAt(0)->x + vtx->nodeAt(1)->x + vtx->nodeAt(2)->x) / 3.0;
+		double cy = (vtx->nodeAt(0)->y + vtx->nodeAt(1)->y + vtx->nodeAt(2)->y) / 3.0;
+		int ci = std::max( 0, std::min( nh - 1, (int)((cx - ox) / cw) ) );
+		int cj = std::max( 0, std::min( nv - 1, (int)((cy - oy) / ch) ) );
+		if( cells[cj * nh + ci] == NULL )
+			cells[cj * nh + ci] = static_cast< BGVertex * >( vtx );
+	}
+	
+	// Empty cells inherit the start triangle of their left or lower neighbour
+	BGVertex *prev = static_cast< BGVertex * >( root );
+	for( j = 0; j < nv; ++j )
+	{
+		for( i = 0; i < nh; ++i )
+		{
+			if( cells[j * nh + i] != NULL )
+				prev = cells[j * nh + i];
+			else if( j > 0 && cells[(j - 1) * nh + i] != NULL )
+				cells[j * nh + i] = cells[(j - 1) * nh + i];
+			else
+				cells[j * nh + i] = prev;
+		}
+	}
+}
+
+BGVertex *BGTriangleMesh::
+startFor( const double ix, const double iy )
+{
+	if( cells == NULL ) return static_cast< BGVertex * >( root );
+	
+	int ci = std::max( 0, std::min( nh - 1, (int)((ix - ox) / cw) ) );
+	int cj = std::max( 0, std::min( nv - 1, (int)((iy - oy) / ch) ) );
+	int cell = cj * nh + ci;
+	
+	// Consecutive queries are usually close; continue from the last hit then
+	if( last != NULL && cell == lastCell ) return last;
+	
+	lastCell = cell;
+	return cells[cell];
+}
+
 double BGTriangleMesh::
 interpolate( const double ix, const double iy )
+{
+	last = startFor( ix, iy )->locate( ix, iy );
+	return last->value( ix, iy );
+}
+
+double BGTriangleMesh::
+walkInterpolate( const double ix, const double iy )
 {
 	BGVertex *vtx = static_cast< BGVertex * >( root );
 	return vtx->interpolate( ix, iy );
 }
 
+void BGTriangleMesh::
+benchmark( const int count )
+{
+	int i;
+	double minx = border[0]->x, maxx = minx, miny = border[0]->y, maxy = miny;
+	int len = border.size();
+	for( i = 1; i < len; ++i )
+	{
+		minx = std::min( minx, border[i]->x ); maxx = std::max( maxx, border[i]->x );
+		miny = std::min( miny, border[i]->y ); maxy = std::max( maxy, border[i]->y );
+	}
+	
+	double *qx = new double[count];
+	double *qy = new double[count];
+	srand( 1 );
+	for( i = 0; i < count; ++i )
+	{
+		qx[i] = minx + (maxx - minx) * rand() / (double)RAND_MAX;
+		qy[i] = miny + (maxy - miny) * rand() / (double)RAND_MAX;
+	}
+	
+	double maxdiff = 0.0;
+	
+	clock_t t0 = clock();
+	for( i = 0; i < count; ++i )
+		walkInterpolate( qx[i], qy[i] );
+	clock_t t1 = clock();
+	for( i = 0; i < count; ++i )
+	{
+		double h = interpolate( qx[i], qy[i] );
+		maxdiff = std::max( maxdiff, fabs( h - walkInterpolate( qx[i], qy[i] ) ) / h );
+	}
+	clock_t t2 = clock();
+	for( i = 0; i < count; ++i )
+		interpolate( qx[i], qy[i] );
+	clock_t t3 = clock();
+	
+	double walk = (double)(t1 - t0) / CLOCKS_PER_SEC;
+	double grid = (double)(t3 - t2) / CLOCKS_PER_SEC;
+	
+	std::cout << "Background mesh: " << len << " nodes, "
+		<< nh << " x " << nv << " locator cells" << std::endl;
+	std::cout << "Walk from root:  " << count / std::max( walk, 1.0e-9 ) << " queries/s" << std::endl;
+	std::cout << "Cached locator:  " << count / std::max( grid, 1.0e-9 ) << " queries/s" << std::endl;
+	std::cout << "Max relative difference: " << maxdiff << std::endl;
+	
+	delete [] qx;
+	delete [] qy;
+}
+
 void blm_error(const char* msg, const char *opt = "");
 
 void BGTriangleMesh::
@@ -47,8 +47,8 @@ initInterpolation( )
 	}
 }
 
-double BGVertex::
-interpolate( const double tx, const double ty )
+BGVertex* BGVertex::
+locate( const double tx, const double ty )
 {
 	bool found = false;
 	int i;
@@ -86,8 +86,11 @@ interpolate( const double tx, const double ty )
 		if( test == curr ) found = true;
 	}
 	
-	BGVertex *vtx = static_cast< BGVertex * >( curr );
-	double val =  UNMAP(vtx->coeff[0] + vtx->coeff[1] * tx + vtx->coeff[2] * ty);
-	
-	return val;
+	return static_cast< BGVertex * >( curr );
+}
+
+double BGVertex::
+interpolate( const double tx, const double ty )
+{
+	return locate( tx, ty )->value( tx, ty );
 }
@@ -392,6 +392,7 @@ removeBoundaryConnectors()
 	const double sqrt3 = 1.7320508075688772935274463415059;
 	
 	pq actives;
+	std::vector< Vertex* > fresh;
 
 	double ref;
 	std::list< Vertex* >::iterator vxIt;
@@ -457,8 +458,6 @@ removeBoundaryConnectors()
 		
 		if( addSite( vtx, nd, false, true, false) == true )
 		{
-			actives.removeRelevants( deleted );
-			
 			int len = newVertices.size();
 			for( int i = 0; i < len; ++i )
 			{
@@ -466,9 +465,12 @@ removeBoundaryConnectors()
 				if( newVertices[i]->isBoundaryConnector(links) )
 				{
 					newVertices[i]->rightSize( 1.0 );
-					actives.insert( newVertices[i] );
+					fresh.push_back( newVertices[i] );
 				}
 			}
+			
+			actives.exchange( deleted, fresh );
+			fresh.clear();
 		}
 		
 		recycle();
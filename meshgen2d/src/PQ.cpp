@@ -6,7 +6,11 @@
 
 pq::
 pq(int chunk)
-{ last = -1; pq_size = 0; pq_reserve(chunk); }
+{
+	last = -1;
+	inserts = removes = updates = heapifies = moves = 0;
+	reserve(chunk);
+}
 
 int pq::
 size()
@@ -18,17 +22,10 @@ Vertex * pq::
 first()
 {
 	if( last < 0 ) return (Vertex *) 0;
-	
+
 	Vertex *v = store[0];
-	
-	if( last > 0 ) remove( v );
-	else
-	{
-		v->setHeap( -1 );
-		last = -1;
-		store[0] = (Vertex *) 0;
-	}
-	
+	remove( v );
+
 	return v;
 }
 
@@ -36,45 +33,58 @@ void pq::
 remove( Vertex *vtx )
 {
 	int h = vtx->atHeap();
-	
+
+	++removes;
+	vtx->setHeap( -1 );
+
 	if( h == last )
 	{
-		vtx->setHeap( -1 );
-		store[last] = (Vertex *) 0;
+		store.pop_back();
+		keys.pop_back();
 		last = last - 1;
 		return;
 	}
-	
-	vtx->setHeap( -1 );
-	
+
 	store[h] = store[last];
+	keys[h] = keys[last];
 	store[h]->setHeap( h );
-	
-	store[last] = (Vertex *) 0;
+
+	store.pop_back();
+	keys.pop_back();
 	last = last - 1;
-	
-	if (h > 0 && store[(h - 1) / 2]->orderingValue() < store[h]->orderingValue())
-		upheap( h );
-	else
-		downheap( h );
+
+	reheap( h );
 }
 
 void pq::
 insert( Vertex *vtx )
 {
-	last = last + 1;
-	
-	if(last == pq_size)
+	if( vtx->isAtHeap() )
 	{
-		pq_reserve(2 * pq_size);
+		update( vtx );
+		return;
 	}
-	
-	store[last] = vtx;
-	store[last]->setHeap( last );
-	
+
+	++inserts;
+	last = last + 1;
+
+	store.push_back( vtx );
+	keys.push_back( vtx->orderingValue() );
+	vtx->setHeap( last );
+
 	upheap( last );
 }
 
+void pq::
+update( Vertex *vtx )
+{
+	int h = vtx->atHeap();
+
+	++updates;
+	keys[h] = vtx->orderingValue();
+	reheap( h );
+}
+
 void pq::
 removeRelevants( std::list< Vertex* >& vl )
 {
@@ -85,7 +95,111 @@ removeRelevants( std::list< Vertex* >& vl )
 		{
 			remove( *it );
 		}
-	}	
+	}
+}
+
+void pq::
+exchange( std::list< Vertex* >& vl, std::vector< Vertex* >& nl )
+{
+	std::list< Vertex* >::iterator it;
+	int i, len = nl.size(), gone = 0;
+
+	for( it = vl.begin(); it != vl.end(); ++it )
+	{
+		if( (*it)->isAtHeap() ) ++gone;
+	}
+
+	// A large change relative to the heap is cheaper to fix with one heapify
+	if( 4 * ( gone + len ) > size() )
+	{
+		for( it = vl.begin(); it != vl.end(); ++it )
+		{
+			Vertex *vtx = *it;
+			if( !vtx->isAtHeap() ) continue;
+
+			int h = vtx->atHeap();
+			vtx->setHeap( -1 );
+			if( h != last )
+			{
+				store[h] = store[last];
+				keys[h] = keys[last];
+				store[h]->setHeap( h );
+			}
+			store.pop_back();
+			keys.pop_back();
+			last = last - 1;
+			++removes;
+		}
+
+		for( i = 0; i < len; ++i )
+		{
+			Vertex *vtx = nl[i];
+			if( vtx->isAtHeap() )
+			{
+				keys[vtx->atHeap()] = vtx->orderingValue();
+				++updates;
+				continue;
+			}
+			last = last + 1;
+			store.push_back( vtx );
+			keys.push_back( vtx->orderingValue() );
+			vtx->setHeap( last );
+			++inserts;
+		}
+
+		heapify();
+		return;
+	}
+
+	// Otherwise each new vertex takes over the slot of a removed one and is
+	// sifted from there, which is a single key change in a valid heap
+	it = vl.begin();
+	for( i = 0; i < len; ++i )
+	{
+		Vertex *vtx = nl[i];
+		if( vtx->isAtHeap() )
+		{
+			update( vtx );
+			continue;
+		}
+
+		while( it != vl.end() && !(*it)->isAtHeap() ) ++it;
+		if( it == vl.end() )
+		{
+			insert( vtx );
+			continue;
+		}
+
+		int h = (*it)->atHeap();
+		(*it)->setHeap( -1 );
+		++it;
+
+		++updates;
+		place( h, vtx );
+		reheap( h );
+	}
+
+	for( ; it != vl.end(); ++it )
+	{
+		if( (*it)->isAtHeap() )
+		{
+			remove( *it );
+		}
+	}
+}
+
+void pq::
+report( const long vertices )
+{
+	long total = inserts + removes + updates;
+	std::cout << "Heap operations: " << inserts << " inserts, " << removes << " removes, "
+		<< updates << " in-place updates, " << heapifies << " heapifies, "
+		<< moves << " moves" << std::endl;
+	if( vertices > 0 )
+	{
+		std::cout << "Heap operations per vertex: " << (double)total / vertices
+			<< ", moves per vertex: " << (double)moves / vertices << std::endl;
+	}
 }
 
 void pq::
@@ -96,25 +210,56 @@ debug()
 	/*
 	for( i = 0; i <= last; ++i )
 	{
-	std::cout << store[i]->atHeap() << ' ' << store[i]->orderingValue() << std::endl;
+	std::cout << store[i]->atHeap() << ' ' << keys[i] << std::endl;
 	}
 	*/
 }
 
+void pq::
+place( const int p, Vertex *vtx )
+{
+	store[p] = vtx;
+	keys[p] = vtx->orderingValue();
+	vtx->setHeap( p );
+}
+
+void pq::
+reheap( const int p )
+{
+	if (p > 0 && keys[(p - 1) / 2] < keys[p])
+		upheap( p );
+	else
+		downheap( p );
+}
+
+void pq::
+heapify()
+{
+	++heapifies;
+	for( int k = (last - 1) / 2; k >= 0; --k )
+	{
+		downheap( k );
+	}
+}
+
 void pq::
 upheap( const int p )
 {
 	int k = p;
 	Vertex *v = store[p];
-	
-	while( k != 0 && store[ ( k - 1 ) / 2 ]->orderingValue() <= v->orderingValue() )
+	double key = keys[p];
+
+	while( k != 0 && keys[ ( k - 1 ) / 2 ] <= key )
 	{
 		store[ k ] = store[ ( k - 1 ) / 2 ];
+		keys[ k ] = keys[ ( k - 1 ) / 2 ];
 		store[ k ]->setHeap( k );
-		
+		++moves;
+
 		k = ( k - 1 ) / 2;
 	}
 	store[ k ] = v;
+	keys[ k ] = key;
 	store[ k ]->setHeap( k );
 }
 
@@ -123,46 +268,30 @@ downheap( const int p )
 {
 	int k = p;
 	Vertex *v = store[p];
+	double key = keys[p];
 	int N = last;
-	
+
 	while( ( k + 1 ) <= ( N + 1 ) / 2 )
 	{
 		int j = k + k + 1;
 		if( j < N )
 		{
-			if( store[ j ]->orderingValue() <= store[ j + 1 ]->orderingValue() )
+			if( keys[ j ] <= keys[ j + 1 ] )
 			{
 				j = j + 1;
 			}
 		}
-		if( store[ j ]->orderingValue() <= v->orderingValue() )
+		if( keys[ j ] <= key )
 		{
 			break;
 		}
 		store[ k ] = store[ j ];
+		keys[ k ] = keys[ j ];
 		store[ k ]->setHeap( k );
+		++moves;
 		k = j;
 	}
 	store[ k ] = v;
-	store[ k ]->setHeap( k );	
-}
-
-void pq::
-pq_reserve(int sz)
-{
-	int osz = pq_size;
-	pq_size = sz;
-	
-	if(osz == 0)
-	{
-		store = new Vertex*[pq_size];
-	}
-	else
-	{
-		Vertex **hold = store;
-		store = new Vertex*[pq_size];
-		memcpy((void *)store, (const void *)hold, osz * sizeof(Vertex *));
-		delete [] hold;
-	}
+	keys[ k ] = key;
+	store[ k ]->setHeap( k );
 }
-
@@ -35,7 +35,7 @@ generate()
 		}
 	}
 	
-	size_t steps = 1;
+	std::vector< Vertex* > fresh;
 	
 	while( actives.size() > 0 )
 	{
@@ -56,8 +56,6 @@ generate()
 			}
 			else
 			{
-				actives.removeRelevants( deleted );
-				
 				int len = newVertices.size();
 				for( int i = 0; i < len; ++i )
 				{
@@ -65,9 +63,12 @@ generate()
 					ref = bg->interpolate( newVertices[i]->vx, newVertices[i]->vy );
 					if( !newVertices[i]->rightSize( ref / sqrt3 ) )
 					{
-						actives.insert( newVertices[i] );
+						fresh.push_back( newVertices[i] );
 					}
 				}
+				
+				actives.exchange( deleted, fresh );
+				fresh.clear();
 			}
 		}
 		
@@ -3,6 +3,8 @@
 
 #include "Connect.h"
 
+class BGVertex;
+
 class BGMesh
 {
 public:
@@ -20,7 +22,8 @@ protected:
 class BGTriangleMesh : public Connect, public BGMesh
 {
 public:
-	BGTriangleMesh() : Connect(-1) { }
+	BGTriangleMesh() : Connect(-1) { cells = NULL; last = NULL; nh = nv = 0; }
+	~BGTriangleMesh() { delete [] cells; }
 	
 	virtual void discretize(NodeMap& fixedNodes, NodeMap& allNodes, 
 		std::list< Element* >& allElements) { }
@@ -30,7 +33,22 @@ public:
 	void getVertices( std::vector< Vertex * >& v, const int count );
 	
 	virtual double interpolate( const double ix, const double iy );
+	double walkInterpolate( const double ix, const double iy );
+	void benchmark( const int count );
 	void dump();
+	
+protected:
+	void makeLocator();
+	BGVertex *startFor( const double ix, const double iy );
+	
+	// Uniform grid of start triangles for the point location walk
+	int nh, nv;
+	double ox, oy, cw, ch;
+	BGVertex **cells;
+	
+	// Triangle found by the previous query, and the cell it was asked in
+	BGVertex *last;
+	int lastCell;
 };
 
 class BGGridMesh : public BGMesh
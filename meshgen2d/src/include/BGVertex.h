@@ -4,6 +4,7 @@
 #include "Vertex.h"
 #include<vector>
 #include "GeometryNode.h"
+#include "coreGeometry.h"
 
 class BGVertex : public Vertex
 {
@@ -12,6 +13,13 @@ public:
 	void initInterpolation( );
 	double interpolate( const double ix, const double iy );
 	
+	// Walk from this triangle to the one containing (ix,iy)
+	BGVertex* locate( const double ix, const double iy );
+	double value( const double ix, const double iy )
+	{
+		return UNMAP(coeff[0] + coeff[1] * ix + coeff[2] * iy);
+	}
+	
 	double coeff[3];
 };
 
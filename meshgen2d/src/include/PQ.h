@@ -12,21 +12,34 @@ public:
 	pq(int chunk = 1024);
 	int size();
 	Vertex *first();
-	
+
 	void insert( Vertex *vtx );
 	void removeRelevants( std::list< Vertex* >& vl );
 	void remove( Vertex *vtx );
-	
+
+	// Re-position a vertex whose ordering value has changed
+	void update( Vertex *vtx );
+	// Remove vl and insert nl, reusing the freed slots in place
+	void exchange( std::list< Vertex* >& vl, std::vector< Vertex* >& nl );
+	void reserve( int sz ) { store.reserve( sz ); keys.reserve( sz ); }
+
+	void report( const long vertices );
 	void debug();
-	
+
 private:
 	void upheap( const int p );
 	void downheap( const int p );
-	void pq_reserve(int sz);
-	
-	Vertex** store;
+	void reheap( const int p );
+	void heapify();
+	void place( const int p, Vertex *vtx );
+
+	// Ordering values are cached next to the handles to avoid virtual calls
+	std::vector< Vertex* > store;
+	std::vector< double > keys;
 	int last;
-	int pq_size;
+
+	// Operation counters
+	long inserts, removes, updates, heapifies, moves;
 };
 
 #endif /* MESH_PQ_H */
@@ -22,6 +22,8 @@
 #include "MeshParser.h"
 #include "Mesh.h"
 #include "MGError.h"
+#include "BGMesh.h"
+#include "GeometryNode.h"
 
 /*
 *	Simple error&exit routine.
@@ -32,12 +34,13 @@ void blm_error(const char* msg, const T &opt);
 
 int main(int argc, char **argv)
 {
-	const char *usage = "Usage: Mesh2D [--bgmesh=filename] [--bgcontrol=filename] <input file> [mesh directory]";
+	const char *usage = "Usage: Mesh2D [--bgmesh=filename] [--bgcontrol=filename] [--bgbench=queries] <input file> [mesh directory]";
 
 	// Read command line parameters
 	char *modelfile = NULL;
 	char *meshdir = NULL;
 	std::map<int, BGMeshToken*> externalBGMeshes;
+	int bgbench = 0;
 
 	for (int i = 1; i < argc; i++)
 	{
@@ -85,6 +88,10 @@ int main(int argc, char **argv)
 
 			externalBGMeshes[-1] = token;
 		}
+		else if (strncmp(argv[i], "--bgbench=", 10) == 0)
+		{
+			bgbench = atoi(argv[i] + 10);
+		}
 		else
 		{
 			std::cerr << usage << std::endl;
@@ -92,6 +99,28 @@ int main(int argc, char **argv)
 		}
 	}
 
+	// Time size queries on the explicit background mesh and quit
+	if (bgbench > 0)
+	{
+		if (externalBGMeshes.find(-1) == externalBGMeshes.end())
+			blm_error("Background mesh benchmark needs --bgmesh=filename", "");
+
+		BGMeshToken *token = externalBGMeshes[-1];
+		std::vector< GeometryNode * > bgnodes;
+		std::vector< GeometryEdge * > dummy;
+		for (int ind = 0; ind < token->nodes.size(); ++ind)
+		{
+			GeometryNode *nd = new GeometryNode( 0, token->nodes[ind].x, token->nodes[ind].y );
+			nd->setDelta( token->nodes[ind].delta );
+			bgnodes.push_back( nd );
+		}
+
+		BGTriangleMesh bgmesh;
+		bgmesh.initialize( bgnodes, dummy );
+		bgmesh.benchmark( bgbench );
+		return 0;
+	}
+
 	if (modelfile == NULL)
 	{
 		std::cerr << usage << std::endl;